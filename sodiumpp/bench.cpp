@@ -0,0 +1,365 @@
+// Copyright (c) 2014, Ruben De Visscher
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <sodiumpp/sodiumpp.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace sodiumpp;
+
+namespace {
+    std::atomic<uint64_t> allocations(0);
+}
+
+// Count every allocation made by the benchmarked code, including inside the sodiumpp library
+void *operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if(void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+
+namespace {
+    /**
+     * The crypto_box_afternm implementation before the move to crypto_box_easy_afternm:
+     * copies the message into a zero-padded buffer, boxes into a second padded buffer
+     * and copies the result out again. Kept here to compare throughput against.
+     */
+    std::string padded_box_afternm(const std::string &m,const std::string &n,const std::string &k,
+                                   std::vector<unsigned char> &mpad,std::vector<unsigned char> &cpad)
+    {
+        size_t mlen = m.size() + crypto_box_ZEROBYTES;
+        for (size_t i = 0;i < crypto_box_ZEROBYTES;++i) mpad[i] = 0;
+        for (size_t i = crypto_box_ZEROBYTES;i < mlen;++i) mpad[i] = m[i - crypto_box_ZEROBYTES];
+        ::crypto_box_afternm(&cpad[0],&mpad[0],mlen,(const unsigned char *) n.c_str(),(const unsigned char *) k.c_str());
+        return std::string((char *) &cpad[0] + crypto_box_BOXZEROBYTES,mlen - crypto_box_BOXZEROBYTES);
+    }
+
+    std::string padded_secretbox(const std::string &m,const std::string &n,const std::string &k,
+                                 std::vector<unsigned char> &mpad,std::vector<unsigned char> &cpad)
+    {
+        size_t mlen = m.size() + crypto_secretbox_ZEROBYTES;
+        for (size_t i = 0;i < crypto_secretbox_ZEROBYTES;++i) mpad[i] = 0;
+        for (size_t i = crypto_secretbox_ZEROBYTES;i < mlen;++i) mpad[i] = m[i - crypto_secretbox_ZEROBYTES];
+        ::crypto_secretbox(&cpad[0],&mpad[0],mlen,(const unsigned char *) n.c_str(),(const unsigned char *) k.c_str());
+        return std::string((char *) &cpad[0] + crypto_secretbox_BOXZEROBYTES,mlen - crypto_secretbox_BOXZEROBYTES);
+    }
+
+    /**
+     * The measurements of one benchmark.
+     */
+    struct result {
+        std::string name;
+        size_t bytes_per_op;
+        uint64_t iterations;
+        double seconds;
+        uint64_t allocations;
+
+        double ns_per_op() const { return seconds * 1e9 / iterations; }
+        double ops_per_second() const { return iterations / seconds; }
+        double bytes_per_second() const { return double(bytes_per_op) * iterations / seconds; }
+        double allocations_per_op() const { return double(allocations) / iterations; }
+    };
+
+    struct options {
+        std::string filter;
+        double min_seconds = 0.25;
+        bool json = false;
+    };
+
+    /**
+     * Runs f in growing batches until at least opts.min_seconds have passed.
+     * bytes_per_op is the number of message bytes processed by one call, or 0 if throughput in bytes is meaningless.
+     */
+    result measure(const options& opts, const std::string& name, size_t bytes_per_op, const std::function<void()>& f) {
+        typedef std::chrono::steady_clock clock;
+        // Warm up caches and lazily initialized state before counting
+        f();
+        uint64_t iterations = 0, batch = 1;
+        uint64_t allocs_before = allocations.load();
+        clock::time_point start = clock::now();
+        clock::duration elapsed;
+        do {
+            for(uint64_t i = 0; i < batch; ++i) f();
+            iterations += batch;
+            if(batch < (1 << 16)) batch *= 2;
+            elapsed = clock::now() - start;
+        } while(std::chrono::duration<double>(elapsed).count() < opts.min_seconds);
+        result r;
+        r.name = name;
+        r.bytes_per_op = bytes_per_op;
+        r.iterations = iterations;
+        r.seconds = std::chrono::duration<double>(elapsed).count();
+        r.allocations = allocations.load() - allocs_before;
+        return r;
+    }
+
+    class runner {
+    private:
+        const options& opts;
+        std::vector<result> results;
+    public:
+        explicit runner(const options& opts) : opts(opts) {
+            if(!opts.json) {
+                std::printf("%-40s %12s %14s %12s %12s\n", "benchmark", "ns/op", "ops/s", "MB/s", "allocs/op");
+            }
+        }
+        void run(const std::string& name, size_t bytes_per_op, const std::function<void()>& f) {
+            if(name.find(opts.filter) == std::string::npos) return;
+            result r = measure(opts, name, bytes_per_op, f);
+            if(!opts.json) {
+                std::printf("%-40s %12.1f %14.1f %12.1f %12.2f\n", r.name.c_str(), r.ns_per_op(), r.ops_per_second(),
+                            r.bytes_per_second() / 1e6, r.allocations_per_op());
+            }
+            results.push_back(r);
+        }
+        /**
+         * Write the results in the JSON format of Google Benchmark, so existing tooling can compare runs.
+         */
+        void write_json() const {
+            char date[64];
+            std::time_t now = std::time(nullptr);
+            std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+            std::printf("{\n  \"context\": {\n");
+            std::printf("    \"date\": \"%s\",\n", date);
+            std::printf("    \"library\": \"sodiumpp\",\n");
+            std::printf("    \"libsodium_version\": \"%s\",\n", sodium_version_string());
+            std::printf("    \"num_cpus\": %u\n", std::thread::hardware_concurrency());
+            std::printf("  },\n  \"benchmarks\": [");
+            for(size_t i = 0; i < results.size(); ++i) {
+                const result& r = results[i];
+                std::printf("%s\n    {\n", i == 0 ? "" : ",");
+                std::printf("      \"name\": \"%s\",\n", r.name.c_str());
+                std::printf("      \"iterations\": %llu,\n", (unsigned long long) r.iterations);
+                std::printf("      \"real_time\": %.3f,\n", r.ns_per_op());
+                std::printf("      \"time_unit\": \"ns\",\n");
+                std::printf("      \"items_per_second\": %.3f,\n", r.ops_per_second());
+                std::printf("      \"bytes_per_second\": %.3f,\n", r.bytes_per_second());
+                std::printf("      \"allocations_per_op\": %.3f\n", r.allocations_per_op());
+                std::printf("    }");
+            }
+            std::printf("\n  ]\n}\n");
+        }
+    };
+
+    std::string sized(const char *name, size_t size) {
+        return std::string(name) + "/" + std::to_string(size);
+    }
+
+    void usage(const char *argv0) {
+        std::fprintf(stderr, "usage: %s [--json] [--filter=SUBSTRING] [--min-time=SECONDS]\n", argv0);
+    }
+}
+
+int main(int argc, const char ** argv) {
+    options opts;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--json") {
+            opts.json = true;
+        } else if(arg.compare(0, 9, "--filter=") == 0) {
+            opts.filter = arg.substr(9);
+        } else if(arg.compare(0, 11, "--min-time=") == 0) {
+            opts.min_seconds = std::atof(arg.c_str() + 11);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if(sodium_init() == -1) return 1;
+
+    std::string sk;
+    std::string pk = crypto_box_keypair(sk);
+    std::string k = crypto_box_beforenm(pk, sk);
+    std::string sign_sk;
+    std::string sign_pk = crypto_sign_keypair(sign_sk);
+    std::string secret_k = randombytes(crypto_secretbox_KEYBYTES);
+    std::string n = randombytes(crypto_box_NONCEBYTES);
+
+    runner bench(opts);
+
+    const size_t sizes[] = { 64, 1024, 16 * 1024, 64 * 1024, 1024 * 1024 };
+    for(size_t size : sizes) {
+        std::string m = randombytes(size);
+        std::vector<unsigned char> mpad(size + crypto_box_ZEROBYTES), cpad(size + crypto_box_ZEROBYTES);
+        std::vector<unsigned char> c(size + crypto_sign_BYTES), out(size + crypto_sign_BYTES);
+
+        if(padded_box_afternm(m, n, k, mpad, cpad) != crypto_box_afternm(m, n, k)) {
+            std::fprintf(stderr, "crypto_box_afternm output differs from the padded implementation\n");
+            return 1;
+        }
+        if(padded_secretbox(m, n, secret_k, mpad, cpad) != crypto_secretbox(m, n, secret_k)) {
+            std::fprintf(stderr, "crypto_secretbox output differs from the padded implementation\n");
+            return 1;
+        }
+
+        bench.run(sized("crypto_box/string", size), size, [&](){ crypto_box(m, n, pk, sk); });
+        bench.run(sized("crypto_box/buffer", size), size, [&](){ crypto_box(&c[0], c.size(), m, n, pk, sk); });
+        std::string boxed = crypto_box_afternm(m, n, k);
+        bench.run(sized("crypto_box_afternm/padded", size), size, [&](){ padded_box_afternm(m, n, k, mpad, cpad); });
+        bench.run(sized("crypto_box_afternm/string", size), size, [&](){ crypto_box_afternm(m, n, k); });
+        bench.run(sized("crypto_box_afternm/buffer", size), size, [&](){ crypto_box_afternm(&c[0], c.size(), m, n, k); });
+        bench.run(sized("crypto_box_open_afternm/string", size), size, [&](){ crypto_box_open_afternm(boxed, n, k); });
+        bench.run(sized("crypto_box_open_afternm/buffer", size), size, [&](){ crypto_box_open_afternm(&out[0], out.size(), boxed, n, k); });
+
+        std::string secretboxed = crypto_secretbox(m, n, secret_k);
+        bench.run(sized("crypto_secretbox/padded", size), size, [&](){ padded_secretbox(m, n, secret_k, mpad, cpad); });
+        bench.run(sized("crypto_secretbox/string", size), size, [&](){ crypto_secretbox(m, n, secret_k); });
+        bench.run(sized("crypto_secretbox/buffer", size), size, [&](){ crypto_secretbox(&c[0], c.size(), m, n, secret_k); });
+        bench.run(sized("crypto_secretbox_open/string", size), size, [&](){ crypto_secretbox_open(secretboxed, n, secret_k); });
+        bench.run(sized("crypto_secretbox_open/buffer", size), size, [&](){ crypto_secretbox_open(&out[0], out.size(), secretboxed, n, secret_k); });
+
+        std::string signed_m = crypto_sign(m, sign_sk);
+        bench.run(sized("crypto_sign/string", size), size, [&](){ crypto_sign(m, sign_sk); });
+        bench.run(sized("crypto_sign/buffer", size), size, [&](){ crypto_sign(&c[0], c.size(), m, sign_sk); });
+        bench.run(sized("crypto_sign_open/string", size), size, [&](){ crypto_sign_open(signed_m, sign_pk); });
+        bench.run(sized("crypto_sign_open/buffer", size), size, [&](){ crypto_sign_open(&out[0], out.size(), signed_m, sign_pk); });
+        std::string sig = crypto_sign_detached(m, sign_sk);
+        bench.run(sized("crypto_sign_detached", size), size, [&](){ crypto_sign_detached(&c[0], c.size(), m, sign_sk); });
+        bench.run(sized("crypto_sign_verify_detached", size), size, [&](){ crypto_sign_verify_detached(bytes_view(sig), m, sign_pk); });
+
+        bench.run(sized("crypto_hash/string", size), size, [&](){ crypto_hash(m); });
+        bench.run(sized("crypto_hash/buffer", size), size, [&](){ crypto_hash(&out[0], crypto_hash_BYTES, m); });
+        bench.run(sized("crypto_generichash/string", size), size, [&](){ crypto_generichash(m, crypto_generichash_BYTES); });
+        bench.run(sized("crypto_generichash/buffer", size), size, [&](){ crypto_generichash(&out[0], crypto_generichash_BYTES, m); });
+        bench.run(sized("sha512_hasher", size), size, [&](){ sha512_hasher().update(m).final(&out[0], crypto_hash_BYTES); });
+        bench.run(sized("blake2b_hasher", size), size, [&](){ blake2b_hasher().update(m).final(&out[0], crypto_generichash_BYTES); });
+        bench.run(sized("tree_hash", size), size, [&](){ tree_hash(m, tree_hash_params(64 * 1024)); });
+
+        std::string stream_n = randombytes(crypto_stream_NONCEBYTES), cipher_k = randombytes(crypto_stream_KEYBYTES);
+        stream_cipher cipher(stream_n, cipher_k);
+        bench.run(sized("crypto_stream_xor/buffer", size), size, [&](){ crypto_stream_xor(&c[0], c.size(), m, stream_n, cipher_k); });
+        bench.run(sized("stream_cipher::xor_at", size), size, [&](){ cipher.xor_at(&c[0], c.size(), m, 0); });
+        bench.run(sized("stream_cipher::xor_at/unaligned", size), size, [&](){ cipher.xor_at(&c[0], c.size(), m, 1); });
+
+        std::string stream_k = randombytes(crypto_secretstream_xchacha20poly1305_KEYBYTES);
+        secretstream_pusher pusher(stream_k);
+        std::string pushed = pusher.push(m);
+        bench.run(sized("secretstream_pusher::push", size), size, [&](){ pusher.push(&c[0], c.size(), m); });
+        bench.run(sized("secretstream_puller::pull", size), size, [&](){
+            secretstream_puller puller(stream_k, pusher.header());
+            secretstream_tag tag;
+            puller.pull(&out[0], out.size(), pushed, tag);
+        });
+
+        std::string z85 = encode_from_binary(m, encoding::z85);
+        std::string hex = encode_from_binary(m, encoding::hex);
+        bench.run(sized("z85_encode", size), size, [&](){ encode_from_binary(m, encoding::z85); });
+        bench.run(sized("z85_decode", size), size, [&](){ decode_to_binary(z85, encoding::z85); });
+        bench.run(sized("hex_encode", size), size, [&](){ encode_from_binary(m, encoding::hex); });
+        bench.run(sized("hex_decode", size), size, [&](){ decode_to_binary(hex, encoding::hex); });
+        encoded_bytes owned(z85, encoding::z85);
+        bench.run(sized("encoded_bytes::to_binary", size), size, [&](){ owned.to_binary(); });
+        bench.run(sized("encoded_bytes::binary", size), size, [&](){ owned.binary(); });
+        bench.run(sized("encoded_bytes::view/binary", size), size, [&](){ encoded_bytes::view(m, encoding::binary).binary(); });
+        encoded_bytes viewed = encoded_bytes::view(z85, encoding::z85);
+        bench.run(sized("encoded_bytes::view/z85/binary", size), size, [&](){ viewed.binary(); });
+    }
+
+    box_secret_key sk_client;
+    box_secret_key sk_server;
+    for(size_t size : sizes) {
+        std::string m = randombytes(size);
+        std::vector<unsigned char> buf(size + crypto_box_MACBYTES);
+        boxer<nonce64> client_boxer(sk_server.pk, sk_client);
+        unboxer<nonce64> server_unboxer(sk_client.pk, sk_server, client_boxer.get_nonce_constant());
+        nonce64 used_n;
+        encoded_bytes boxed = client_boxer.box(m, used_n);
+
+        bench.run(sized("boxer::box", size), size, [&](){ client_boxer.box(m); });
+        bench.run(sized("boxer::box_inplace", size), size, [&](){ client_boxer.box_inplace(&buf[0], size); });
+        bench.run(sized("unboxer::unbox", size), size, [&](){ server_unboxer.unbox(boxed, used_n); });
+
+        const size_t batch = 64;
+        std::vector<bytes_view> messages(batch, bytes_view(m));
+        std::string out;
+        std::vector<size_t> offsets;
+        bench.run(sized("boxer::box_batch/64", size), batch * size, [&](){ client_boxer.box_batch(messages, out, offsets); });
+    }
+
+    // Many small keys, as in a deduplication index
+    for(size_t size : { 16, 64, 128 }) {
+        const size_t batch = 1024;
+        std::vector<std::string> keys;
+        for(size_t i = 0; i < batch; ++i) keys.push_back(randombytes(size));
+        std::vector<bytes_view> messages(keys.begin(), keys.end());
+        std::string short_k = randombytes(crypto_shorthash_KEYBYTES);
+        std::string out(batch * crypto_generichash_BYTES, 0);
+        unsigned char *out_bytes = (unsigned char *)&out[0];
+        bench.run(sized("crypto_shorthash/1024", size), batch * size, [&](){
+            for(size_t i = 0; i < batch; ++i) crypto_shorthash(out_bytes + i * crypto_shorthash_BYTES, crypto_shorthash_BYTES, messages[i], short_k);
+        });
+        bench.run(sized("crypto_shorthash_batch/1024", size), batch * size, [&](){ crypto_shorthash_batch(out_bytes, out.size(), messages, short_k); });
+        bench.run(sized("crypto_generichash/1024", size), batch * size, [&](){
+            for(size_t i = 0; i < batch; ++i) crypto_generichash(out_bytes + i * crypto_generichash_BYTES, crypto_generichash_BYTES, messages[i]);
+        });
+        bench.run(sized("crypto_generichash_batch/1024", size), batch * size, [&](){ crypto_generichash_batch(out_bytes, out.size(), crypto_generichash_BYTES, messages); });
+    }
+
+    // Many small signed log lines
+    {
+        const size_t batch = 256;
+        std::vector<std::string> lines, signatures;
+        std::vector<signature_check> checks;
+        for(size_t i = 0; i < batch; ++i) {
+            lines.push_back(randombytes(128));
+            signatures.push_back(crypto_sign(lines.back(), sign_sk).substr(0, crypto_sign_BYTES));
+        }
+        for(size_t i = 0; i < batch; ++i) checks.push_back(signature_check(lines[i], signatures[i], sign_pk));
+        std::string forged = signatures[0];
+        forged[0] ^= 1;
+        bench.run("crypto_sign_verify_batch/256", 0, [&](){ crypto_sign_verify_batch(checks); });
+        bench.run("crypto_sign_open/failure", 0, [&](){
+            try { crypto_sign_open(forged + lines[0], sign_pk); } catch(const crypto_error&) {}
+        });
+    }
+
+    std::string out_pk(crypto_box_PUBLICKEYBYTES, 0), out_sk(crypto_box_SECRETKEYBYTES, 0);
+    bench.run("crypto_box_keypair", 0, [&](){ crypto_box_keypair((unsigned char *)&out_pk[0], out_pk.size(), (unsigned char *)&out_sk[0], out_sk.size()); });
+    bench.run("crypto_box_beforenm", 0, [&](){ crypto_box_beforenm((unsigned char *)&out_sk[0], out_sk.size(), pk, sk); });
+    bench.run("box_secret_key", 0, [&](){ box_secret_key generated; });
+    {
+        thread_pool key_workers;
+        box_keypair_factory factory(4096, &key_workers);
+        factory.fill();
+        bench.run("box_keypair_factory::pop", 0, [&](){ factory.pop(); });
+    }
+    bench.run("boxer<nonce64>", 0, [&](){ boxer<nonce64> b(sk_server.pk, sk_client); });
+    shared_key_cache cache;
+    bench.run("boxer<nonce64>/shared_key_cache", 0, [&](){ boxer<nonce64> b(sk_server.pk, sk_client, cache); });
+
+    if(opts.json) bench.write_json();
+    return 0;
+}
@@ -0,0 +1,297 @@
+// Copyright (c) 2014, Ruben De Visscher
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <sodiumpp/sodiumpp.h>
+#include <algorithm>
+#include <cerrno>
+#include <functional>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    // Files are mapped this many bytes at a time, so the address space and page cache used stay bounded
+    const size_t map_window = 64 << 20;
+
+    typedef std::function<void(sodiumpp::bytes_view)> sink;
+
+    unsigned long long read_fd(int fd, size_t chunk_size, const sink& update) {
+        if(chunk_size == 0) throw std::invalid_argument("chunk size must not be 0");
+        std::vector<unsigned char> buf(chunk_size);
+        unsigned long long total = 0;
+        for(;;) {
+            ssize_t n = ::read(fd, &buf[0], buf.size());
+            if(n < 0) {
+                if(errno == EINTR) continue;
+                throw std::system_error(errno, std::generic_category(), "read");
+            }
+            if(n == 0) return total;
+            update(sodiumpp::bytes_view(&buf[0], n));
+            total += n;
+        }
+    }
+
+    struct file_descriptor {
+        int fd;
+        explicit file_descriptor(const std::string& path) : fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC)) {
+            if(fd < 0) throw std::system_error(errno, std::generic_category(), "open " + path);
+        }
+        ~file_descriptor() { ::close(fd); }
+    };
+
+    struct mapping {
+        void *addr;
+        size_t len;
+        mapping(int fd, off_t offset, size_t len) : addr(::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, offset)), len(len) {
+            if(addr == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "mmap");
+            ::madvise(addr, len, MADV_SEQUENTIAL);
+        }
+        ~mapping() { ::munmap(addr, len); }
+    };
+
+    unsigned long long map_file(const std::string& path, const sink& update) {
+        file_descriptor file(path);
+        struct stat st;
+        if(::fstat(file.fd, &st) != 0) throw std::system_error(errno, std::generic_category(), "fstat " + path);
+        // Pipes, devices and the like cannot be mapped
+        if(!S_ISREG(st.st_mode)) return read_fd(file.fd, 1 << 20, update);
+        unsigned long long size = st.st_size;
+        for(unsigned long long offset = 0; offset < size; offset += map_window) {
+            size_t len = size - offset < map_window ? size - offset : map_window;
+            mapping window(file.fd, offset, len);
+            update(sodiumpp::bytes_view(window.addr, len));
+        }
+        return size;
+    }
+
+    // Hash tree node prefixes
+    const unsigned char tree_leaf = 0, tree_node = 1, tree_root = 2;
+
+    void store_le64(unsigned char *p, unsigned long long v) {
+        for(int i = 0; i < 8; ++i) p[i] = static_cast<unsigned char>(v >> (8 * i));
+    }
+
+    void check_params(const sodiumpp::tree_hash_params& params) {
+        if(params.leaf_size == 0) throw std::invalid_argument("leaf size must not be 0");
+        if(params.fanout < 2) throw std::invalid_argument("fanout must be at least 2");
+        if(params.digest_len < crypto_generichash_BYTES_MIN || params.digest_len > crypto_generichash_BYTES_MAX) throw std::invalid_argument("incorrect digest length");
+    }
+
+    void hash_leaf(unsigned char *out, sodiumpp::bytes_view data, unsigned long long index, size_t digest_len) {
+        unsigned char prefix[9] = {tree_leaf};
+        store_le64(prefix + 1, index);
+        sodiumpp::blake2b_hasher(digest_len).update(sodiumpp::bytes_view(prefix, sizeof(prefix))).update(data).final(out, digest_len);
+    }
+
+    // Ranges of about 64 KiB of input, so small leaves and nodes are not scheduled one by one
+    size_t grain_for(size_t bytes_per_item) {
+        return 1 + (64 * 1024) / bytes_per_item;
+    }
+
+    std::string root_from_leaves(std::string level, unsigned long long size, const sodiumpp::tree_hash_params& params, sodiumpp::executor *ex) {
+        const size_t d = params.digest_len;
+        size_t count = level.size() / d;
+        while(count > 1) {
+            const size_t parents = (count - 1) / params.fanout + 1;
+            std::string next(parents * d, 0);
+            sodiumpp::parallel_for(ex, parents, grain_for(params.fanout * d), [&](size_t begin, size_t end) {
+                for(size_t i = begin; i < end; ++i) {
+                    size_t first = i * params.fanout;
+                    size_t children = std::min(params.fanout, count - first);
+                    sodiumpp::blake2b_hasher(d).update(sodiumpp::bytes_view(&tree_node, 1))
+                        .update(sodiumpp::bytes_view(level.data() + first * d, children * d))
+                        .final(reinterpret_cast<unsigned char *>(&next[i * d]), d);
+                }
+            });
+            level.swap(next);
+            count = parents;
+        }
+        unsigned char prefix[25] = {tree_root};
+        store_le64(prefix + 1, size);
+        store_le64(prefix + 9, params.leaf_size);
+        store_le64(prefix + 17, params.fanout);
+        return sodiumpp::blake2b_hasher(d).update(sodiumpp::bytes_view(prefix, sizeof(prefix))).update(level).final();
+    }
+}
+
+sodiumpp::sha512_hasher::sha512_hasher() : finalized(false) {
+    crypto_hash_sha512_init(&state);
+}
+
+sodiumpp::sha512_hasher::~sha512_hasher() {
+    sodium_memzero(&state, sizeof(state));
+}
+
+sodiumpp::sha512_hasher& sodiumpp::sha512_hasher::update(bytes_view m) {
+    if(finalized) throw std::logic_error("hasher already finalized");
+    crypto_hash_sha512_update(&state, m.data(), m.size());
+    return *this;
+}
+
+unsigned long long sodiumpp::sha512_hasher::update_fd(int fd, size_t chunk_size) {
+    return read_fd(fd, chunk_size, [this](bytes_view m) { update(m); });
+}
+
+unsigned long long sodiumpp::sha512_hasher::update_file(const std::string& path) {
+    return map_file(path, [this](bytes_view m) { update(m); });
+}
+
+size_t sodiumpp::sha512_hasher::final(unsigned char *h, size_t hlen) {
+    if(finalized) throw std::logic_error("hasher already finalized");
+    if(hlen < crypto_hash_sha512_BYTES) throw std::invalid_argument("output buffer too small");
+    crypto_hash_sha512_final(&state, h);
+    finalized = true;
+    return crypto_hash_sha512_BYTES;
+}
+
+std::string sodiumpp::sha512_hasher::final() {
+    std::string h(crypto_hash_sha512_BYTES, 0);
+    final(reinterpret_cast<unsigned char *>(&h[0]), h.size());
+    return h;
+}
+
+sodiumpp::blake2b_hasher::blake2b_hasher(size_t output_len, bytes_view k) : output_len(output_len), finalized(false) {
+    if(output_len < crypto_generichash_BYTES_MIN || output_len > crypto_generichash_BYTES_MAX) throw std::invalid_argument("incorrect output length");
+    if(!k.empty() && (k.size() < crypto_generichash_KEYBYTES_MIN || k.size() > crypto_generichash_KEYBYTES_MAX)) throw std::invalid_argument("incorrect key length");
+    crypto_generichash_init(&state, k.data(), k.size(), output_len);
+}
+
+sodiumpp::blake2b_hasher::~blake2b_hasher() {
+    sodium_memzero(&state, sizeof(state));
+}
+
+sodiumpp::blake2b_hasher& sodiumpp::blake2b_hasher::update(bytes_view m) {
+    if(finalized) throw std::logic_error("hasher already finalized");
+    crypto_generichash_update(&state, m.data(), m.size());
+    return *this;
+}
+
+unsigned long long sodiumpp::blake2b_hasher::update_fd(int fd, size_t chunk_size) {
+    return read_fd(fd, chunk_size, [this](bytes_view m) { update(m); });
+}
+
+unsigned long long sodiumpp::blake2b_hasher::update_file(const std::string& path) {
+    return map_file(path, [this](bytes_view m) { update(m); });
+}
+
+size_t sodiumpp::blake2b_hasher::final(unsigned char *h, size_t hlen) {
+    if(finalized) throw std::logic_error("hasher already finalized");
+    if(hlen < output_len) throw std::invalid_argument("output buffer too small");
+    crypto_generichash_final(&state, h, output_len);
+    finalized = true;
+    return output_len;
+}
+
+std::string sodiumpp::blake2b_hasher::final() {
+    std::string h(output_len, 0);
+    final(reinterpret_cast<unsigned char *>(&h[0]), h.size());
+    return h;
+}
+
+std::string sodiumpp::crypto_hash_fd(int fd) {
+    sha512_hasher hasher;
+    hasher.update_fd(fd);
+    return hasher.final();
+}
+
+std::string sodiumpp::crypto_hash_file(const std::string& path) {
+    sha512_hasher hasher;
+    hasher.update_file(path);
+    return hasher.final();
+}
+
+std::string sodiumpp::crypto_generichash_fd(int fd, size_t output_len, const std::string &k) {
+    blake2b_hasher hasher(output_len, k);
+    hasher.update_fd(fd);
+    return hasher.final();
+}
+
+std::string sodiumpp::crypto_generichash_file(const std::string& path, size_t output_len, const std::string &k) {
+    blake2b_hasher hasher(output_len, k);
+    hasher.update_file(path);
+    return hasher.final();
+}
+
+sodiumpp::tree_hash_result sodiumpp::tree_hash(bytes_view m, const tree_hash_params& params, executor *ex) {
+    check_params(params);
+    const size_t leaves = params.leaf_count(m.size());
+    tree_hash_result result;
+    result.digest_len = params.digest_len;
+    result.leaves.resize(leaves * params.digest_len);
+    parallel_for(ex, leaves, grain_for(params.leaf_size), [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; ++i) {
+            size_t offset = i * params.leaf_size;
+            bytes_view data(m.data() + offset, std::min(params.leaf_size, m.size() - offset));
+            hash_leaf(reinterpret_cast<unsigned char *>(&result.leaves[i * params.digest_len]), data, i, params.digest_len);
+        }
+    });
+    result.root = root_from_leaves(result.leaves, m.size(), params, ex);
+    return result;
+}
+
+sodiumpp::tree_hash_result sodiumpp::tree_hash_file(const std::string& path, const tree_hash_params& params, executor *ex) {
+    check_params(params);
+    file_descriptor file(path);
+    struct stat st;
+    if(::fstat(file.fd, &st) != 0) throw std::system_error(errno, std::generic_category(), "fstat " + path);
+    if(!S_ISREG(st.st_mode)) throw std::invalid_argument("not a regular file: " + path);
+    const unsigned long long size = st.st_size;
+    const size_t leaves = params.leaf_count(size);
+    tree_hash_result result;
+    result.digest_len = params.digest_len;
+    result.leaves.resize(leaves * params.digest_len);
+    parallel_for(ex, leaves, grain_for(params.leaf_size), [&](size_t begin, size_t end) {
+        std::vector<unsigned char> buf(params.leaf_size);
+        for(size_t i = begin; i < end; ++i) {
+            unsigned long long offset = (unsigned long long)i * params.leaf_size;
+            size_t len = std::min<unsigned long long>(params.leaf_size, size - offset);
+            for(size_t done = 0; done < len; ) {
+                ssize_t n = ::pread(file.fd, &buf[done], len - done, offset + done);
+                if(n < 0 && errno == EINTR) continue;
+                if(n < 0) throw std::system_error(errno, std::generic_category(), "pread " + path);
+                if(n == 0) throw std::system_error(EIO, std::generic_category(), "file shrank while hashing " + path);
+                done += n;
+            }
+            hash_leaf(reinterpret_cast<unsigned char *>(&result.leaves[i * params.digest_len]), bytes_view(buf.data(), len), i, params.digest_len);
+        }
+    });
+    result.root = root_from_leaves(result.leaves, size, params, ex);
+    return result;
+}
+
+std::string sodiumpp::tree_hash_leaf(bytes_view data, unsigned long long index, const tree_hash_params& params) {
+    check_params(params);
+    if(data.size() > params.leaf_size) throw std::invalid_argument("leaf larger than leaf size");
+    std::string digest(params.digest_len, 0);
+    hash_leaf(reinterpret_cast<unsigned char *>(&digest[0]), data, index, params.digest_len);
+    return digest;
+}
+
+std::string sodiumpp::tree_hash_root(bytes_view leaf_digests, unsigned long long size, const tree_hash_params& params, executor *ex) {
+    check_params(params);
+    if(leaf_digests.size() != params.leaf_count(size) * params.digest_len) throw std::invalid_argument("incorrect number of leaf digests");
+    return root_from_leaves(leaf_digests.str(), size, params, ex);
+}
@@ -0,0 +1,333 @@
+// Copyright (c) 2014, Ruben De Visscher
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <sodiumpp/sodiumpp.h>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SODIUMPP_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace {
+    using sodiumpp::bytes_view;
+
+    /*
+     * One message at a time through libsodium, for the messages that do not fill a group of lanes and on other CPUs.
+     */
+    void shorthash_scalar(unsigned char *out, const bytes_view *messages, size_t count, const unsigned char *k) {
+        for(size_t i = 0; i < count; ++i) {
+            ::crypto_shorthash(out + i * crypto_shorthash_BYTES, messages[i].data(), messages[i].size(), k);
+        }
+    }
+
+    void generichash_scalar(unsigned char *out, size_t hash_len, const bytes_view *messages, size_t count, bytes_view k) {
+        for(size_t i = 0; i < count; ++i) {
+            ::crypto_generichash(out + i * hash_len, hash_len, messages[i].data(), messages[i].size(), k.data(), k.size());
+        }
+    }
+
+#ifdef SODIUMPP_X86_SIMD
+    /*
+     * Interleaved kernels: each 64-bit lane of an AVX2 register holds the state of a different message, so four messages
+     * are hashed with the instructions one message would need. Lanes whose message has fewer blocks than the others in
+     * its group keep their state with a blend once they are done; messages of similar length therefore batch best.
+     * The results are checked against libsodium by the tests.
+     */
+    const size_t lanes = 4;
+
+    uint64_t load64(const unsigned char *p) {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    template <int b>
+    __attribute__((target("avx2")))
+    inline __m256i rotl(__m256i x) { return _mm256_or_si256(_mm256_slli_epi64(x, b), _mm256_srli_epi64(x, 64 - b)); }
+
+    __attribute__((target("avx2")))
+    inline void sipround(__m256i& v0, __m256i& v1, __m256i& v2, __m256i& v3) {
+        v0 = _mm256_add_epi64(v0, v1); v1 = rotl<13>(v1); v1 = _mm256_xor_si256(v1, v0); v0 = _mm256_shuffle_epi32(v0, 0xb1);
+        v2 = _mm256_add_epi64(v2, v3); v3 = rotl<16>(v3); v3 = _mm256_xor_si256(v3, v2);
+        v0 = _mm256_add_epi64(v0, v3); v3 = rotl<21>(v3); v3 = _mm256_xor_si256(v3, v0);
+        v2 = _mm256_add_epi64(v2, v1); v1 = rotl<17>(v1); v1 = _mm256_xor_si256(v1, v2); v2 = _mm256_shuffle_epi32(v2, 0xb1);
+    }
+
+    /** SipHash-2-4 of count messages, a multiple of lanes */
+    __attribute__((target("avx2")))
+    void shorthash_avx2(unsigned char *out, const bytes_view *messages, size_t count, const unsigned char *k) {
+        const uint64_t k0 = load64(k), k1 = load64(k + 8);
+        for(size_t g = 0; g < count; g += lanes) {
+            const bytes_view *m = messages + g;
+            size_t blocks[lanes], max_blocks = 0;
+            bool uniform = true;
+            for(size_t l = 0; l < lanes; ++l) {
+                blocks[l] = m[l].size() / 8 + 1;
+                max_blocks = std::max(max_blocks, blocks[l]);
+                uniform = uniform && blocks[l] == blocks[0];
+            }
+            __m256i v0 = _mm256_set1_epi64x(k0 ^ 0x736f6d6570736575ULL);
+            __m256i v1 = _mm256_set1_epi64x(k1 ^ 0x646f72616e646f6dULL);
+            __m256i v2 = _mm256_set1_epi64x(k0 ^ 0x6c7967656e657261ULL);
+            __m256i v3 = _mm256_set1_epi64x(k1 ^ 0x7465646279746573ULL);
+            // Blocks that are whole in every lane are loaded straight from the messages
+            const size_t whole = *std::min_element(blocks, blocks + lanes) - 1;
+            for(size_t j = 0; j < whole; ++j) {
+                const __m256i w = _mm256_set_epi64x(load64(m[3].data() + 8 * j), load64(m[2].data() + 8 * j),
+                                                    load64(m[1].data() + 8 * j), load64(m[0].data() + 8 * j));
+                v3 = _mm256_xor_si256(v3, w);
+                sipround(v0, v1, v2, v3);
+                sipround(v0, v1, v2, v3);
+                v0 = _mm256_xor_si256(v0, w);
+            }
+            for(size_t j = whole; j < max_blocks; ++j) {
+                uint64_t words[lanes];
+                int64_t active[lanes];
+                for(size_t l = 0; l < lanes; ++l) {
+                    active[l] = j < blocks[l] ? -1 : 0;
+                    if(j + 1 < blocks[l]) {
+                        words[l] = load64(m[l].data() + 8 * j);
+                    } else if(j + 1 == blocks[l]) {
+                        // The last block holds the remaining bytes and the message length in its top byte
+                        uint64_t last = uint64_t(m[l].size()) << 56;
+                        for(size_t b = 0; b < m[l].size() % 8; ++b) last |= uint64_t(m[l].data()[8 * j + b]) << (8 * b);
+                        words[l] = last;
+                    } else {
+                        words[l] = 0;
+                    }
+                }
+                const __m256i w = _mm256_set_epi64x(words[3], words[2], words[1], words[0]);
+                const __m256i u0 = v0, u1 = v1, u2 = v2, u3 = v3;
+                v3 = _mm256_xor_si256(v3, w);
+                sipround(v0, v1, v2, v3);
+                sipround(v0, v1, v2, v3);
+                v0 = _mm256_xor_si256(v0, w);
+                if(!uniform) {
+                    const __m256i a = _mm256_set_epi64x(active[3], active[2], active[1], active[0]);
+                    v0 = _mm256_blendv_epi8(u0, v0, a);
+                    v1 = _mm256_blendv_epi8(u1, v1, a);
+                    v2 = _mm256_blendv_epi8(u2, v2, a);
+                    v3 = _mm256_blendv_epi8(u3, v3, a);
+                }
+            }
+            v2 = _mm256_xor_si256(v2, _mm256_set1_epi64x(0xff));
+            for(int r = 0; r < 4; ++r) sipround(v0, v1, v2, v3);
+            _mm256_storeu_si256((__m256i *) (out + g * crypto_shorthash_BYTES),
+                                _mm256_xor_si256(_mm256_xor_si256(v0, v1), _mm256_xor_si256(v2, v3)));
+        }
+    }
+
+    const uint64_t blake2b_iv[8] = {
+        0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+        0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+    };
+
+    const unsigned char blake2b_sigma[12][16] = {
+        { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+        { 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3 },
+        { 11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4 },
+        { 7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8 },
+        { 9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13 },
+        { 2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9 },
+        { 12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11 },
+        { 13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10 },
+        { 6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5 },
+        { 10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0 },
+        { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+        { 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3 }
+    };
+
+    const size_t blake2b_block = 128;
+
+    __attribute__((target("avx2")))
+    inline void blake2b_g(__m256i& a, __m256i& b, __m256i& c, __m256i& d, __m256i x, __m256i y) {
+        const __m256i r16 = _mm256_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+                                             2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9);
+        const __m256i r24 = _mm256_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10,
+                                             3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10);
+        a = _mm256_add_epi64(_mm256_add_epi64(a, b), x);
+        d = _mm256_shuffle_epi32(_mm256_xor_si256(d, a), 0xb1);
+        c = _mm256_add_epi64(c, d);
+        b = _mm256_shuffle_epi8(_mm256_xor_si256(b, c), r24);
+        a = _mm256_add_epi64(_mm256_add_epi64(a, b), y);
+        d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), r16);
+        c = _mm256_add_epi64(c, d);
+        b = _mm256_xor_si256(b, c);
+        b = _mm256_xor_si256(_mm256_srli_epi64(b, 63), _mm256_add_epi64(b, b));
+    }
+
+    /** Loads word i of each lane's block into lane l of w[i], transposing four 4x4 matrices of words */
+    __attribute__((target("avx2")))
+    inline void blake2b_load(__m256i w[16], const unsigned char *const block[lanes]) {
+        for(int q = 0; q < 4; ++q) {
+            __m256i r0 = _mm256_loadu_si256((const __m256i *) (block[0] + 32 * q));
+            __m256i r1 = _mm256_loadu_si256((const __m256i *) (block[1] + 32 * q));
+            __m256i r2 = _mm256_loadu_si256((const __m256i *) (block[2] + 32 * q));
+            __m256i r3 = _mm256_loadu_si256((const __m256i *) (block[3] + 32 * q));
+            __m256i t0 = _mm256_unpacklo_epi64(r0, r1), t1 = _mm256_unpackhi_epi64(r0, r1);
+            __m256i t2 = _mm256_unpacklo_epi64(r2, r3), t3 = _mm256_unpackhi_epi64(r2, r3);
+            w[4 * q + 0] = _mm256_permute2x128_si256(t0, t2, 0x20);
+            w[4 * q + 1] = _mm256_permute2x128_si256(t1, t3, 0x20);
+            w[4 * q + 2] = _mm256_permute2x128_si256(t0, t2, 0x31);
+            w[4 * q + 3] = _mm256_permute2x128_si256(t1, t3, 0x31);
+        }
+    }
+
+    /** BLAKE2b of count messages, a multiple of lanes, with an optional key of 16 to 64 bytes */
+    __attribute__((target("avx2")))
+    void generichash_avx2(unsigned char *out, size_t hash_len, const bytes_view *messages, size_t count, bytes_view k) {
+        // A key is hashed as a first block of its own, padded with zeros
+        unsigned char key_block[blake2b_block] = {0};
+        std::memcpy(key_block, k.data(), k.size());
+        const size_t key_blocks = k.empty() ? 0 : 1;
+        const uint64_t param = 0x01010000ULL ^ (uint64_t(k.size()) << 8) ^ hash_len;
+
+        for(size_t g = 0; g < count; g += lanes) {
+            const bytes_view *m = messages + g;
+            size_t blocks[lanes], max_blocks = 0;
+            uint64_t total[lanes];
+            bool uniform = true;
+            for(size_t l = 0; l < lanes; ++l) {
+                size_t message_blocks = (m[l].size() + blake2b_block - 1) / blake2b_block;
+                blocks[l] = key_blocks + (message_blocks == 0 && key_blocks == 0 ? 1 : message_blocks);
+                total[l] = key_blocks * blake2b_block + m[l].size();
+                max_blocks = std::max(max_blocks, blocks[l]);
+                uniform = uniform && blocks[l] == blocks[0];
+            }
+            __m256i h[8];
+            for(int i = 0; i < 8; ++i) h[i] = _mm256_set1_epi64x(blake2b_iv[i] ^ (i == 0 ? param : 0));
+
+            for(size_t j = 0; j < max_blocks; ++j) {
+                unsigned char padded[lanes][blake2b_block];
+                const unsigned char *block[lanes];
+                alignas(32) uint64_t counter[lanes];
+                alignas(32) int64_t last[lanes], active[lanes];
+                for(size_t l = 0; l < lanes; ++l) {
+                    active[l] = j < blocks[l] ? -1 : 0;
+                    last[l] = j + 1 == blocks[l] ? -1 : 0;
+                    counter[l] = std::min<uint64_t>(blake2b_block * (j + 1), total[l]);
+                    if(j < key_blocks) {
+                        block[l] = key_block;
+                        continue;
+                    }
+                    size_t offset = (j - key_blocks) * blake2b_block;
+                    if(offset + blake2b_block <= m[l].size()) {
+                        block[l] = m[l].data() + offset;
+                    } else {
+                        std::memset(padded[l], 0, blake2b_block);
+                        if(offset < m[l].size()) std::memcpy(padded[l], m[l].data() + offset, m[l].size() - offset);
+                        block[l] = padded[l];
+                    }
+                }
+                __m256i w[16];
+                blake2b_load(w, block);
+                __m256i v[16];
+                for(int i = 0; i < 8; ++i) {
+                    v[i] = h[i];
+                    v[i + 8] = _mm256_set1_epi64x(blake2b_iv[i]);
+                }
+                v[12] = _mm256_xor_si256(v[12], _mm256_load_si256((const __m256i *) counter));
+                v[14] = _mm256_xor_si256(v[14], _mm256_load_si256((const __m256i *) last));
+                for(int r = 0; r < 12; ++r) {
+                    const unsigned char *s = blake2b_sigma[r];
+                    blake2b_g(v[0], v[4], v[8], v[12], w[s[0]], w[s[1]]);
+                    blake2b_g(v[1], v[5], v[9], v[13], w[s[2]], w[s[3]]);
+                    blake2b_g(v[2], v[6], v[10], v[14], w[s[4]], w[s[5]]);
+                    blake2b_g(v[3], v[7], v[11], v[15], w[s[6]], w[s[7]]);
+                    blake2b_g(v[0], v[5], v[10], v[15], w[s[8]], w[s[9]]);
+                    blake2b_g(v[1], v[6], v[11], v[12], w[s[10]], w[s[11]]);
+                    blake2b_g(v[2], v[7], v[8], v[13], w[s[12]], w[s[13]]);
+                    blake2b_g(v[3], v[4], v[9], v[14], w[s[14]], w[s[15]]);
+                }
+                const __m256i a = _mm256_load_si256((const __m256i *) active);
+                for(int i = 0; i < 8; ++i) {
+                    __m256i next = _mm256_xor_si256(h[i], _mm256_xor_si256(v[i], v[i + 8]));
+                    h[i] = uniform ? next : _mm256_blendv_epi8(h[i], next, a);
+                }
+            }
+
+            alignas(32) uint64_t words[8][lanes];
+            for(int i = 0; i < 8; ++i) _mm256_store_si256((__m256i *) words[i], h[i]);
+            for(size_t l = 0; l < lanes; ++l) {
+                uint64_t digest[8];
+                for(int i = 0; i < 8; ++i) digest[i] = words[i][l];
+                std::memcpy(out + (g + l) * hash_len, digest, hash_len);
+            }
+        }
+    }
+
+    bool has_avx2() {
+        static const bool avx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+        return avx2;
+    }
+#endif
+
+    void shorthash_range(unsigned char *out, const bytes_view *messages, size_t count, const unsigned char *k) {
+        size_t done = 0;
+#ifdef SODIUMPP_X86_SIMD
+        if(has_avx2()) {
+            done = count - count % lanes;
+            shorthash_avx2(out, messages, done, k);
+        }
+#endif
+        shorthash_scalar(out + done * crypto_shorthash_BYTES, messages + done, count - done, k);
+    }
+
+    void generichash_range(unsigned char *out, size_t hash_len, const bytes_view *messages, size_t count, bytes_view k) {
+        size_t done = 0;
+#ifdef SODIUMPP_X86_SIMD
+        if(has_avx2()) {
+            done = count - count % lanes;
+            generichash_avx2(out, hash_len, messages, done, k);
+        }
+#endif
+        generichash_scalar(out + done * hash_len, hash_len, messages + done, count - done, k);
+    }
+
+    // Ranges of about 64 KiB of input in whole groups of four messages, so small messages are not scheduled one by one
+    size_t grain_for(const std::vector<bytes_view>& messages) {
+        size_t total = 0;
+        for(const bytes_view& m : messages) total += m.size();
+        size_t grain = 1 + (64 * 1024) / (1 + total / (messages.empty() ? 1 : messages.size()));
+        return (grain + 3) & ~size_t(3);
+    }
+}
+
+void sodiumpp::crypto_shorthash_batch(unsigned char *out, size_t outlen, const std::vector<bytes_view>& messages, bytes_view k, executor *ex) {
+    if(k.size() != crypto_shorthash_KEYBYTES) throw std::invalid_argument("incorrect key length");
+    if(outlen / crypto_shorthash_BYTES < messages.size()) throw std::invalid_argument("output buffer too small");
+    parallel_for(ex, messages.size(), grain_for(messages), [&](size_t begin, size_t end) {
+        shorthash_range(out + begin * crypto_shorthash_BYTES, messages.data() + begin, end - begin, k.data());
+    });
+}
+
+void sodiumpp::crypto_generichash_batch(unsigned char *out, size_t outlen, size_t hash_len, const std::vector<bytes_view>& messages, bytes_view k, executor *ex) {
+    if(hash_len < crypto_generichash_BYTES_MIN || hash_len > crypto_generichash_BYTES_MAX) throw std::invalid_argument("incorrect output length");
+    if(!k.empty() && (k.size() < crypto_generichash_KEYBYTES_MIN || k.size() > crypto_generichash_KEYBYTES_MAX)) throw std::invalid_argument("incorrect key length");
+    if(outlen / hash_len < messages.size()) throw std::invalid_argument("output buffer too small");
+    parallel_for(ex, messages.size(), grain_for(messages), [&](size_t begin, size_t end) {
+        generichash_range(out + begin * hash_len, hash_len, messages.data() + begin, end - begin, k);
+    });
+}
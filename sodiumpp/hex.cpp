@@ -0,0 +1,272 @@
+// Copyright (c) 2014, Ruben De Visscher
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <sodiumpp/sodiumpp.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SODIUMPP_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace {
+    const char hex_digits[] = "0123456789abcdef";
+
+    /*
+     * Scalar code, used for the bytes the SIMD kernels leave and on other CPUs.
+     * The constant-time variants compute digits and values with arithmetic only, as sodium_bin2hex and sodium_hex2bin do.
+     */
+    void encode_constant_time(char *hex, const unsigned char *bin, size_t len) {
+        for(size_t i = 0; i < len; ++i) {
+            unsigned int hi = bin[i] >> 4, lo = bin[i] & 0xf;
+            hex[2*i] = (char) (87U + hi + (((hi - 10U) >> 8) & ~38U));
+            hex[2*i+1] = (char) (87U + lo + (((lo - 10U) >> 8) & ~38U));
+        }
+    }
+
+    void encode_fast(char *hex, const unsigned char *bin, size_t len) {
+        for(size_t i = 0; i < len; ++i) {
+            hex[2*i] = hex_digits[bin[i] >> 4];
+            hex[2*i+1] = hex_digits[bin[i] & 0xf];
+        }
+    }
+
+    /** Returns the value of hexadecimal digit c, and sets bit 8 of invalid if c is not a hexadecimal digit. */
+    unsigned int digit_constant_time(unsigned char c, unsigned int& invalid) {
+        unsigned int num = c ^ 48U;
+        unsigned int num0 = ((num - 10U) >> 8) & 0xff;
+        unsigned int alpha = (c & ~32U) - 55U;
+        unsigned int alpha0 = (((alpha - 10U) ^ (alpha - 16U)) >> 8) & 0xff;
+        invalid |= ((num0 | alpha0) - 1U) & 0x100;
+        return ((num0 & num) | (alpha0 & alpha)) & 0xf;
+    }
+
+    /** Returns 0 if a character is not a hexadecimal digit. */
+    bool decode_constant_time(unsigned char *bin, const char *hex, size_t len) {
+        unsigned int invalid = 0;
+        for(size_t i = 0; i < len; ++i) {
+            unsigned int hi = digit_constant_time(hex[2*i], invalid);
+            unsigned int lo = digit_constant_time(hex[2*i+1], invalid);
+            bin[i] = (unsigned char) (hi << 4 | lo);
+        }
+        return invalid == 0;
+    }
+
+    /** Value of every character, 0xff for characters that are not hexadecimal digits. */
+    struct digit_table {
+        unsigned char values[256];
+        digit_table() {
+            for(int c = 0; c < 256; ++c) {
+                values[c] = 0xff;
+                if(c >= '0' && c <= '9') values[c] = c - '0';
+                if(c >= 'a' && c <= 'f') values[c] = c - 'a' + 10;
+                if(c >= 'A' && c <= 'F') values[c] = c - 'A' + 10;
+            }
+        }
+    };
+
+    bool decode_fast(unsigned char *bin, const char *hex, size_t len) {
+        static const digit_table table;
+        for(size_t i = 0; i < len; ++i) {
+            unsigned char hi = table.values[(unsigned char) hex[2*i]];
+            unsigned char lo = table.values[(unsigned char) hex[2*i+1]];
+            if((hi | lo) == 0xff) return false;
+            bin[i] = (unsigned char) (hi << 4 | lo);
+        }
+        return true;
+    }
+
+#ifdef SODIUMPP_X86_SIMD
+    /*
+     * SIMD kernels. They take or produce whole vectors and return the number of binary bytes they handled.
+     * Digits are produced with a byte shuffle of a 16-entry table held in a register, and parsed with compares,
+     * so neither direction accesses memory depending on the data. With stop_early the decoders return as soon as
+     * a vector contains an invalid character, otherwise they always run to the end and report invalid input afterwards.
+     */
+    __attribute__((target("ssse3")))
+    size_t encode_ssse3(char *hex, const unsigned char *bin, size_t len) {
+        const __m128i digits = _mm_loadu_si128((const __m128i *) hex_digits);
+        const __m128i mask = _mm_set1_epi8(0x0f);
+        size_t i = 0;
+        for(; i + 16 <= len; i += 16) {
+            __m128i in = _mm_loadu_si128((const __m128i *) (bin + i));
+            __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(in, 4), mask));
+            __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(in, mask));
+            _mm_storeu_si128((__m128i *) (hex + 2*i), _mm_unpacklo_epi8(hi, lo));
+            _mm_storeu_si128((__m128i *) (hex + 2*i + 16), _mm_unpackhi_epi8(hi, lo));
+        }
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    size_t encode_avx2(char *hex, const unsigned char *bin, size_t len) {
+        const __m256i digits = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) hex_digits));
+        const __m256i mask = _mm256_set1_epi8(0x0f);
+        size_t i = 0;
+        for(; i + 32 <= len; i += 32) {
+            // Quarters 0 and 2 in the low lane, 1 and 3 in the high lane, so the per-lane unpacks produce consecutive digits
+            __m256i in = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *) (bin + i)), 0xd8);
+            __m256i hi = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(in, 4), mask));
+            __m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(in, mask));
+            _mm256_storeu_si256((__m256i *) (hex + 2*i), _mm256_unpacklo_epi8(hi, lo));
+            _mm256_storeu_si256((__m256i *) (hex + 2*i + 32), _mm256_unpackhi_epi8(hi, lo));
+        }
+        return i;
+    }
+
+    /** Returns the values of the hexadecimal digits in c, and sets bytes of invalid where c is not a hexadecimal digit. */
+    __attribute__((target("ssse3")))
+    inline __m128i digits_ssse3(__m128i c, __m128i& invalid) {
+        __m128i num = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+        __m128i num_ok = _mm_cmpeq_epi8(_mm_min_epu8(num, _mm_set1_epi8(9)), num);
+        __m128i alpha = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+        __m128i alpha_ok = _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(5)), alpha);
+        invalid = _mm_or_si128(invalid, _mm_andnot_si128(_mm_or_si128(num_ok, alpha_ok), _mm_set1_epi8(-1)));
+        return _mm_or_si128(_mm_and_si128(num_ok, num), _mm_and_si128(alpha_ok, _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+    }
+
+    __attribute__((target("ssse3")))
+    size_t decode_ssse3(unsigned char *bin, const char *hex, size_t len, bool stop_early, bool& valid) {
+        // High digit times 16 plus low digit, for every pair of bytes
+        const __m128i weights = _mm_set1_epi16(0x0110);
+        __m128i invalid = _mm_setzero_si128();
+        size_t i = 0;
+        for(; i + 16 <= len; i += 16) {
+            __m128i a = digits_ssse3(_mm_loadu_si128((const __m128i *) (hex + 2*i)), invalid);
+            __m128i b = digits_ssse3(_mm_loadu_si128((const __m128i *) (hex + 2*i + 16)), invalid);
+            if(stop_early && _mm_movemask_epi8(invalid)) break;
+            __m128i out = _mm_packus_epi16(_mm_maddubs_epi16(a, weights), _mm_maddubs_epi16(b, weights));
+            _mm_storeu_si128((__m128i *) (bin + i), out);
+        }
+        valid = _mm_movemask_epi8(invalid) == 0;
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i digits_avx2(__m256i c, __m256i& invalid) {
+        __m256i num = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+        __m256i num_ok = _mm256_cmpeq_epi8(_mm256_min_epu8(num, _mm256_set1_epi8(9)), num);
+        __m256i alpha = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+        __m256i alpha_ok = _mm256_cmpeq_epi8(_mm256_min_epu8(alpha, _mm256_set1_epi8(5)), alpha);
+        invalid = _mm256_or_si256(invalid, _mm256_andnot_si256(_mm256_or_si256(num_ok, alpha_ok), _mm256_set1_epi8(-1)));
+        return _mm256_or_si256(_mm256_and_si256(num_ok, num), _mm256_and_si256(alpha_ok, _mm256_add_epi8(alpha, _mm256_set1_epi8(10))));
+    }
+
+    __attribute__((target("avx2")))
+    size_t decode_avx2(unsigned char *bin, const char *hex, size_t len, bool stop_early, bool& valid) {
+        const __m256i weights = _mm256_set1_epi16(0x0110);
+        __m256i invalid = _mm256_setzero_si256();
+        size_t i = 0;
+        for(; i + 32 <= len; i += 32) {
+            __m256i a = digits_avx2(_mm256_loadu_si256((const __m256i *) (hex + 2*i)), invalid);
+            __m256i b = digits_avx2(_mm256_loadu_si256((const __m256i *) (hex + 2*i + 32)), invalid);
+            if(stop_early && _mm256_movemask_epi8(invalid)) break;
+            // The pack interleaves the lanes of a and b, restore the order of the quarters
+            __m256i out = _mm256_packus_epi16(_mm256_maddubs_epi16(a, weights), _mm256_maddubs_epi16(b, weights));
+            _mm256_storeu_si256((__m256i *) (bin + i), _mm256_permute4x64_epi64(out, 0xd8));
+        }
+        valid = _mm256_movemask_epi8(invalid) == 0;
+        return i;
+    }
+
+    enum class simd_level { scalar, ssse3, avx2 };
+
+    simd_level detect_simd_level() {
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2")) return simd_level::avx2;
+        if(__builtin_cpu_supports("ssse3")) return simd_level::ssse3;
+        return simd_level::scalar;
+    }
+
+    simd_level current_simd_level() {
+        static const simd_level level = detect_simd_level();
+        return level;
+    }
+#endif
+
+    void encode(char *hex, const unsigned char *bin, size_t len, sodiumpp::hex_mode mode) {
+        size_t done = 0;
+#ifdef SODIUMPP_X86_SIMD
+        switch(current_simd_level()) {
+            case simd_level::avx2: done = encode_avx2(hex, bin, len); break;
+            case simd_level::ssse3: done = encode_ssse3(hex, bin, len); break;
+            case simd_level::scalar: break;
+        }
+#endif
+        if(mode == sodiumpp::hex_mode::fast) {
+            encode_fast(hex + 2*done, bin + done, len - done);
+        } else {
+            encode_constant_time(hex + 2*done, bin + done, len - done);
+        }
+    }
+
+    /** Decodes 2 * len hexadecimal digits to len bytes at bin. */
+    bool decode(unsigned char *bin, const char *hex, size_t len, sodiumpp::hex_mode mode) {
+        bool fast = mode == sodiumpp::hex_mode::fast;
+        bool valid = true;
+        size_t done = 0;
+#ifdef SODIUMPP_X86_SIMD
+        switch(current_simd_level()) {
+            case simd_level::avx2: done = decode_avx2(bin, hex, len, fast, valid); break;
+            case simd_level::ssse3: done = decode_ssse3(bin, hex, len, fast, valid); break;
+            case simd_level::scalar: break;
+        }
+        if(fast && !valid) return false;
+#endif
+        unsigned char *rest = bin + done;
+        if(fast) {
+            return decode_fast(rest, hex + 2*done, len - done);
+        }
+        // Always decode everything, so the time taken does not depend on where an invalid character is
+        bool rest_valid = decode_constant_time(rest, hex + 2*done, len - done);
+        return valid & rest_valid;
+    }
+}
+
+size_t sodiumpp::bin2hex(char *hex, size_t hexlen, bytes_view bin, hex_mode mode) {
+    if (hexlen / 2 < bin.size()) throw std::invalid_argument("output buffer too small");
+    encode(hex, bin.data(), bin.size(), mode);
+    return 2 * bin.size();
+}
+
+std::string sodiumpp::bin2hex(const std::string& bytes, hex_mode mode) {
+    std::string hex(2 * bytes.size(), 0);
+    bin2hex(&hex[0], hex.size(), bytes, mode);
+    return hex;
+}
+
+size_t sodiumpp::hex2bin(unsigned char *bin, size_t binlen, bytes_view hex, hex_mode mode) {
+    if (hex.size() % 2 != 0) throw std::invalid_argument("length must be even");
+    if (binlen < hex.size() / 2) throw std::invalid_argument("output buffer too small");
+    if (!decode(bin, reinterpret_cast<const char *>(hex.data()), hex.size() / 2, mode)) {
+        sodium_memzero(bin, hex.size() / 2);
+        throw std::invalid_argument("string must be all hexadecimal digits");
+    }
+    return hex.size() / 2;
+}
+
+std::string sodiumpp::hex2bin(const std::string& bytes, hex_mode mode) {
+    if (bytes.size() % 2 != 0) throw std::invalid_argument("length must be even");
+    std::string bin(bytes.size() / 2, 0);
+    hex2bin(reinterpret_cast<unsigned char *>(&bin[0]), bin.size(), bytes, mode);
+    return bin;
+}
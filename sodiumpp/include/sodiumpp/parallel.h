@@ -0,0 +1,95 @@
+// Copyright (c) 2014, Ruben De Visscher
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef sodiumpp_parallel_h
+#define sodiumpp_parallel_h
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sodiumpp {
+    /**
+     * Runs tasks, possibly concurrently with the caller.
+     *
+     * The parallel operations in sodiumpp accept any executor, so an existing thread pool can be used by
+     * implementing execute() on top of it. Tasks submitted by sodiumpp never throw.
+     */
+    class executor {
+    public:
+        virtual ~executor() {}
+        /**
+         * Schedule task to be run once, on any thread.
+         */
+        virtual void execute(std::function<void()> task) = 0;
+        /**
+         * Returns the number of tasks that can usefully run at the same time.
+         */
+        virtual size_t concurrency() const { return std::thread::hardware_concurrency(); }
+    };
+
+    /**
+     * An executor with a fixed number of worker threads.
+     * Tasks that are still queued when the pool is destroyed are run before the workers exit.
+     */
+    class thread_pool : public executor {
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable available;
+        bool stopping;
+        void work();
+    public:
+        /**
+         * Start threads worker threads, by default one per hardware thread.
+         */
+        explicit thread_pool(size_t threads = std::thread::hardware_concurrency());
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+        /**
+         * Run the remaining tasks and join the worker threads.
+         */
+        ~thread_pool();
+        void execute(std::function<void()> task) override;
+        /**
+         * Returns the number of worker threads.
+         */
+        size_t concurrency() const override { return workers.size(); }
+    };
+
+    /**
+     * Calls body(begin, end) for consecutive ranges of at most grain indices that together cover [0, count),
+     * and returns when all of them have completed.
+     * The calling thread works on ranges as well, and ex is used to run additional workers,
+     * so this is safe to call from a task that is itself running on ex.
+     * If ex is nullptr all ranges are run on the calling thread.
+     * If body throws, no further ranges are started and the first exception is rethrown on the calling thread.
+     */
+    void parallel_for(executor *ex, size_t count, size_t grain, const std::function<void(size_t, size_t)>& body);
+}
+
+#endif
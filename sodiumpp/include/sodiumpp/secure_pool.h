@@ -0,0 +1,80 @@
+// Copyright (c) 2014, Ruben De Visscher
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef sodiumpp_secure_pool_h
+#define sodiumpp_secure_pool_h
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace sodiumpp {
+    /**
+     * Process-wide pool of fixed-size slots of locked memory for keys and other secrets.
+     *
+     * Locked memory is allocated in chunks of slots_per_chunk slots, each chunk with a single sodium_malloc call,
+     * so it is locked and surrounded by guard pages once instead of once per secret.
+     * Slots are zeroed when they are returned and handed out again before a new chunk is allocated,
+     * so the amount of locked memory is bounded by the largest number of secrets that were alive at the same time.
+     * All member functions are thread-safe.
+     */
+    class secure_pool {
+    private:
+        mutable std::mutex mutex;
+        std::vector<unsigned char *> chunks;
+        std::vector<unsigned char *> free_slots;
+        secure_pool() {}
+    public:
+        /** The size in bytes of every slot */
+        static const size_t slot_size = 64;
+        /** The number of slots that are allocated and locked at once */
+        static const size_t slots_per_chunk = 1024;
+
+        /**
+         * Returns the pool shared by the whole process.
+         * The pool is never destroyed, so secrets in objects with static storage duration can be released at any time.
+         */
+        static secure_pool& instance();
+        secure_pool(const secure_pool&) = delete;
+        secure_pool& operator=(const secure_pool&) = delete;
+        /**
+         * Returns a zeroed slot of slot_size bytes.
+         * Throws std::bad_alloc if a new chunk is needed and cannot be allocated.
+         */
+        unsigned char *allocate();
+        /**
+         * Zero slot and make it available again. slot must have been returned by allocate().
+         */
+        void deallocate(unsigned char *slot);
+        /**
+         * Returns the total number of slots in locked memory.
+         */
+        size_t capacity() const;
+        /**
+         * Returns the number of slots that are currently allocated.
+         */
+        size_t in_use() const;
+    };
+}
+
+#endif
@@ -24,24 +24,81 @@
 #ifndef sodiumpp_h
 #define sodiumpp_h
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <new>
 #include <string>
 #include <stdexcept>
 #include <type_traits>
+#include <vector>
 
 extern "C" {
 #include <sodium.h>
 }
 #include <sodiumpp/z85.hpp>
+#include <sodiumpp/parallel.h>
+#include <sodiumpp/secure_pool.h>
 
 namespace sodiumpp {
+    /**
+     * Non-owning view of a series of bytes: a pointer and a length.
+     *
+     * All crypto_* functions have an overload taking bytes_views as input and a caller-provided output buffer.
+     * These overloads write their result directly into the output buffer and never allocate.
+     * A bytes_view can be implicitly constructed from a std::string, which must outlive the view.
+     */
+    class bytes_view {
+    private:
+        const unsigned char *ptr;
+        size_t len;
+    public:
+        /**
+         * Construct an empty view.
+         */
+        bytes_view() : ptr(nullptr), len(0) {}
+        /**
+         * Construct a view of size bytes starting at data.
+         */
+        bytes_view(const void *data, size_t size) : ptr(static_cast<const unsigned char *>(data)), len(size) {}
+        /**
+         * Construct a view of the bytes in the string s.
+         */
+        bytes_view(const std::string& s) : ptr(reinterpret_cast<const unsigned char *>(s.data())), len(s.size()) {}
+        const unsigned char *data() const { return ptr; }
+        size_t size() const { return len; }
+        bool empty() const { return len == 0; }
+        const unsigned char *begin() const { return ptr; }
+        const unsigned char *end() const { return ptr + len; }
+        /**
+         * Return a copy of the viewed bytes.
+         */
+        std::string str() const { return std::string(reinterpret_cast<const char *>(ptr), len); }
+    };
+
     std::string crypto_auth(const std::string &m,const std::string &k);
+    /**
+     * Computes the authenticator of message m under key k and writes it to a, which must have room for crypto_auth_BYTES bytes.
+     * Returns the number of bytes written.
+     */
+    size_t crypto_auth(unsigned char *a,size_t alen,bytes_view m,bytes_view k);
     void crypto_auth_verify(const std::string &a,const std::string &m,const std::string &k);
+    void crypto_auth_verify(bytes_view a,bytes_view m,bytes_view k);
     /**
      * Performs the box operation on message m, using nonce n, from secret key sk to public key pk.
      * Throws std::invalid_argument if any of the arguments are invalid
      */
     std::string crypto_box(const std::string &m,const std::string &n,const std::string &pk,const std::string &sk);
+    /**
+     * Performs the box operation on message m and writes the boxed message to c,
+     * which must have room for m.size() + crypto_box_MACBYTES bytes.
+     * c may point to the same memory as m.
+     * Returns the number of bytes written.
+     * Throws std::invalid_argument if any of the arguments are invalid or c is too small.
+     */
+    size_t crypto_box(unsigned char *c,size_t clen,bytes_view m,bytes_view n,bytes_view pk,bytes_view sk);
     /**
      * Generate a new keypair for box operations.
      * The secret key is stored in sk_string, and the public key is returned.
@@ -49,6 +106,11 @@ namespace sodiumpp {
      * This function was changed from the official NaCl API: it accepts a reference instead of a pointer to sk_string.
      */
     std::string crypto_box_keypair(std::string &sk_string);
+    /**
+     * Generate a new keypair for box operations into pk and sk.
+     * Throws std::invalid_argument if pklen or sklen are not crypto_box_PUBLICKEYBYTES and crypto_box_SECRETKEYBYTES.
+     */
+    void crypto_box_keypair(unsigned char *pk,size_t pklen,unsigned char *sk,size_t sklen);
     /**
      * If many box operations are performed between the same pair of keypairs,
      * The operation can be split in crypto_box_beforenm, which is performed once and crypto_box_afternm, 
@@ -57,6 +119,11 @@ namespace sodiumpp {
      * Throws std::invalid_argument if any of the arguments are invalid.
      */
     const std::string crypto_box_beforenm(const std::string &pk, const std::string &sk);
+    /**
+     * Writes the afternm parameter for public key pk and secret key sk to k, which must have room for crypto_box_BEFORENMBYTES bytes.
+     * Returns the number of bytes written.
+     */
+    size_t crypto_box_beforenm(unsigned char *k,size_t klen,bytes_view pk,bytes_view sk);
     /**
      * If many box operations are performed between the same pair of keypairs,
      * The operation can be split in beforenm, which is performed once and afternm, 
@@ -65,12 +132,24 @@ namespace sodiumpp {
      * Throws std::invalid_argument if any of the arguments are invalid.
      */
     std::string crypto_box_afternm(const std::string &m,const std::string &n,const std::string &k);
+    /**
+     * Boxes m using the beforenm parameter k and writes the boxed message to c,
+     * which must have room for m.size() + crypto_box_MACBYTES bytes.
+     * c may point to the same memory as m.
+     * Returns the number of bytes written.
+     */
+    size_t crypto_box_afternm(unsigned char *c,size_t clen,bytes_view m,bytes_view n,bytes_view k);
     /**
      * Unbox a boxed message c, using the nonce n, with the sender's public key pk and the receiver's secret key sk.
      * Returns the unboxed message.
      * Throws crypto_error if the ciphertext failed verification, throws std::invalid_argument if any of the arguments are invalid.
      */
     std::string crypto_box_open(const std::string &c,const std::string &n,const std::string &pk,const std::string &sk);
+    /**
+     * Unboxes c and writes the message to m, which must have room for c.size() - crypto_box_MACBYTES bytes.
+     * Returns the number of bytes written.
+     */
+    size_t crypto_box_open(unsigned char *m,size_t mlen,bytes_view c,bytes_view n,bytes_view pk,bytes_view sk);
     /**
      * If many unbox operations are performed between the same pair of keypairs,
      * The operation can be split in crypto_box_beforenm, which is performed once and crypto_box_open_afternm, 
@@ -79,11 +158,34 @@ namespace sodiumpp {
      * Throws crypto_error if the ciphertext fails verification, throws std::invalid_argument if any of the arguments are invalid.
      */
     std::string crypto_box_open_afternm(const std::string &c,const std::string &n,const std::string &k);
+    /**
+     * Unboxes c using the beforenm parameter k and writes the message to m, which must have room for c.size() - crypto_box_MACBYTES bytes.
+     * Returns the number of bytes written.
+     */
+    size_t crypto_box_open_afternm(unsigned char *m,size_t mlen,bytes_view c,bytes_view n,bytes_view k);
+    /**
+     * Boxes m using the beforenm parameter k, and writes the ciphertext to c and the crypto_box_MACBYTES bytes MAC to mac.
+     * c must have room for m.size() bytes and may point to the same memory as m.
+     * Returns the number of bytes written to c.
+     */
+    size_t crypto_box_detached_afternm(unsigned char *c,unsigned char *mac,bytes_view m,bytes_view n,bytes_view k);
+    /**
+     * Verifies the MAC mac of the ciphertext c using the beforenm parameter k, and writes the message to m.
+     * m must have room for c.size() bytes and may point to the same memory as c.
+     * Returns the number of bytes written.
+     * Throws crypto_error if the ciphertext fails verification.
+     */
+    size_t crypto_box_open_detached_afternm(unsigned char *m,bytes_view c,bytes_view mac,bytes_view n,bytes_view k);
 	/**
 	 * Function hashes a message m. It returns a hash h. The output length h.size() is always crypto_hash_BYTES.
 	 * Hash function: SHA 512
 	 */
     std::string crypto_hash(const std::string &m);
+    /**
+     * Hashes m and writes the hash to h, which must have room for crypto_hash_BYTES bytes.
+     * Returns the number of bytes written.
+     */
+    size_t crypto_hash(unsigned char *h,size_t hlen,bytes_view m);
 
 	/**
 	 * Function hashes a message m. It returns a hash h.
@@ -95,11 +197,169 @@ namespace sodiumpp {
 	 * Hash function: BLAKE2b
 	 */
 	std::string crypto_generichash(const std::string &m, size_t output_len, const std::string &k = "");
+	/**
+	 * Hashes m with optional key k and writes a hash of exactly hlen bytes to h.
+	 * @returns the number of bytes written
+	 */
+	size_t crypto_generichash(unsigned char *h, size_t hlen, bytes_view m, bytes_view k = bytes_view());
+	/**
+	 * Computes crypto_generichash with hash_len bytes and optional key k of every message in messages, spreading the work over ex if it is not nullptr.
+	 * Hash i is written to out + i * hash_len, so out must have room for messages.size() * hash_len bytes.
+	 * On CPUs with AVX2 four messages are hashed at once.
+	 */
+	void crypto_generichash_batch(unsigned char *out, size_t outlen, size_t hash_len, const std::vector<bytes_view>& messages,
+	                              bytes_view k = bytes_view(), executor *ex = nullptr);
+
+    /**
+     * Computes the crypto_hash (SHA-512) of a message that is passed in parts to update().
+     * Memory use is constant, whatever the length of the message.
+     */
+    class sha512_hasher {
+    private:
+        crypto_hash_sha512_state state;
+        bool finalized;
+    public:
+        sha512_hasher();
+        ~sha512_hasher();
+        /**
+         * Appends m to the message.
+         * Throws std::logic_error if final() has already been called.
+         */
+        sha512_hasher& update(bytes_view m);
+        /**
+         * Appends everything read from fd until end of file, in chunks of chunk_size bytes.
+         * Returns the number of bytes read, and throws std::system_error if reading fails.
+         */
+        unsigned long long update_fd(int fd, size_t chunk_size = 1 << 20);
+        /**
+         * Appends the contents of the file at path, which is mapped into memory a window at a time.
+         * Returns the size of the file, and throws std::system_error if it cannot be opened or mapped.
+         */
+        unsigned long long update_file(const std::string& path);
+        /**
+         * Writes the hash of the message to h, which must have room for crypto_hash_BYTES bytes, and returns the number of bytes written.
+         * Throws std::logic_error if final() has already been called.
+         */
+        size_t final(unsigned char *h, size_t hlen);
+        std::string final();
+    };
+
+    /**
+     * Computes the crypto_generichash (BLAKE2b) of a message that is passed in parts to update().
+     * Memory use is constant, whatever the length of the message.
+     */
+    class blake2b_hasher {
+    private:
+        crypto_generichash_state state;
+        size_t output_len;
+        bool finalized;
+    public:
+        /**
+         * Start hashing with an output of output_len bytes and the optional key k.
+         * Throws std::invalid_argument if output_len or the length of k is outside the range allowed by crypto_generichash.
+         */
+        explicit blake2b_hasher(size_t output_len = crypto_generichash_BYTES, bytes_view k = bytes_view());
+        ~blake2b_hasher();
+        /**
+         * Appends m to the message.
+         * Throws std::logic_error if final() has already been called.
+         */
+        blake2b_hasher& update(bytes_view m);
+        /**
+         * Appends everything read from fd until end of file, in chunks of chunk_size bytes.
+         * Returns the number of bytes read, and throws std::system_error if reading fails.
+         */
+        unsigned long long update_fd(int fd, size_t chunk_size = 1 << 20);
+        /**
+         * Appends the contents of the file at path, which is mapped into memory a window at a time.
+         * Returns the size of the file, and throws std::system_error if it cannot be opened or mapped.
+         */
+        unsigned long long update_file(const std::string& path);
+        /**
+         * Writes the hash of the message to h, which must have room for output_len bytes, and returns the number of bytes written.
+         * Throws std::logic_error if final() has already been called.
+         */
+        size_t final(unsigned char *h, size_t hlen);
+        std::string final();
+    };
+
+    /**
+     * Returns the crypto_hash of everything read from fd until end of file.
+     */
+    std::string crypto_hash_fd(int fd);
+    /**
+     * Returns the crypto_hash of the contents of the file at path, using a memory mapping.
+     */
+    std::string crypto_hash_file(const std::string& path);
+    /**
+     * Returns the crypto_generichash with output_len bytes and key k of everything read from fd until end of file.
+     */
+    std::string crypto_generichash_fd(int fd, size_t output_len, const std::string &k = "");
+    /**
+     * Returns the crypto_generichash with output_len bytes and key k of the contents of the file at path, using a memory mapping.
+     */
+    std::string crypto_generichash_file(const std::string& path, size_t output_len, const std::string &k = "");
+
+    /**
+     * The shape of the hash tree built by tree_hash. Every party must use the same parameters to get the same root.
+     */
+    struct tree_hash_params {
+        size_t leaf_size; /** The number of message bytes per leaf; only the last leaf may be shorter */
+        size_t fanout; /** The number of children of every internal node, except the last node of a level */
+        size_t digest_len; /** The crypto_generichash output length of every node */
+        tree_hash_params(size_t leaf_size = 1 << 20, size_t fanout = 16, size_t digest_len = crypto_generichash_BYTES)
+            : leaf_size(leaf_size), fanout(fanout), digest_len(digest_len) {}
+        /**
+         * Returns the number of leaves of a message of size bytes; an empty message has one empty leaf.
+         */
+        unsigned long long leaf_count(unsigned long long size) const { return size == 0 ? 1 : (size - 1) / leaf_size + 1; }
+    };
+
+    /**
+     * The root digest of a hash tree and the digests of its leaves.
+     */
+    struct tree_hash_result {
+        std::string root;
+        std::string leaves; /** The digests of all leaves, digest_len bytes each, in message order */
+        size_t digest_len;
+        size_t leaf_count() const { return leaves.size() / digest_len; }
+        /**
+         * Returns the digest of leaf i, which is tree_hash_leaf() of bytes [i * leaf_size, (i + 1) * leaf_size) of the message.
+         */
+        bytes_view leaf(size_t i) const { return bytes_view(leaves.data() + i * digest_len, digest_len); }
+    };
+
+    /**
+     * Hashes m as a tree of crypto_generichash digests, hashing the leaves and the levels above them on ex if it is not nullptr.
+     * Leaves are hashed as 0x00 || index || data and internal nodes as 0x01 || child digests,
+     * and the root is the hash of 0x02 || the message size || leaf_size || fanout || the top node, with 64-bit little-endian numbers.
+     * Throws std::invalid_argument if leaf_size is 0, fanout is less than 2, or digest_len is not a valid crypto_generichash length.
+     */
+    tree_hash_result tree_hash(bytes_view m, const tree_hash_params& params = tree_hash_params(), executor *ex = nullptr);
+    /**
+     * Like tree_hash, for the contents of the regular file at path. Each range of leaves is read with its own leaf_size buffer,
+     * so memory use depends on the concurrency of ex and not on the size of the file.
+     * Throws std::system_error if the file cannot be read.
+     */
+    tree_hash_result tree_hash_file(const std::string& path, const tree_hash_params& params = tree_hash_params(), executor *ex = nullptr);
+    /**
+     * Returns the digest of leaf number index with the bytes data, to check a range of a message against tree_hash_result::leaf().
+     */
+    std::string tree_hash_leaf(bytes_view data, unsigned long long index, const tree_hash_params& params = tree_hash_params());
+    /**
+     * Returns the root of the tree over a message of size bytes with the given leaf digests, as computed by tree_hash.
+     * Throws std::invalid_argument if the number of leaf digests does not match size.
+     */
+    std::string tree_hash_root(bytes_view leaf_digests, unsigned long long size, const tree_hash_params& params = tree_hash_params(), executor *ex = nullptr);
 
     std::string crypto_onetimeauth(const std::string &m,const std::string &k);
+    size_t crypto_onetimeauth(unsigned char *a,size_t alen,bytes_view m,bytes_view k);
     void crypto_onetimeauth_verify(const std::string &a,const std::string &m,const std::string &k);
+    void crypto_onetimeauth_verify(bytes_view a,bytes_view m,bytes_view k);
     std::string crypto_scalarmult_base(const std::string &n);
+    size_t crypto_scalarmult_base(unsigned char *q,size_t qlen,bytes_view n);
     std::string crypto_scalarmult(const std::string &n,const std::string &p);
+    size_t crypto_scalarmult(unsigned char *q,size_t qlen,bytes_view n,bytes_view p);
 	/**
 	 * Encrypts and authenticates a message m using a secret key k and a nonce n.
 	 * @param m message
@@ -111,6 +371,14 @@ namespace sodiumpp {
 	 * Exception safety: Strong exception safety
 	 */
     std::string crypto_secretbox(const std::string &m,const std::string &n,const std::string &k);
+	/**
+	 * Encrypts and authenticates a message m into the caller-provided buffer c.
+	 * @param c output buffer, must have room for m.size() + crypto_secretbox_MACBYTES bytes, may point to the same memory as m
+	 * @param clen size of c
+	 * @returns the number of bytes written
+	 * @throw std::invalid_argument if any of the arguments are invalid or c is too small
+	 */
+    size_t crypto_secretbox(unsigned char *c,size_t clen,bytes_view m,bytes_view n,bytes_view k);
 	/**
 	 * Verifies and decrypts a ciphertext c using a secret key k and a nonce n.
 	 * @param c ciphertext
@@ -123,30 +391,144 @@ namespace sodiumpp {
 	 * Exception safety: Strong exception safety
 	 */
     std::string crypto_secretbox_open(const std::string &c,const std::string &n,const std::string &k);
+	/**
+	 * Verifies and decrypts a ciphertext c into the caller-provided buffer m.
+	 * @param m output buffer, must have room for c.size() - crypto_secretbox_MACBYTES bytes
+	 * @param mlen size of m
+	 * @returns the number of bytes written
+	 * @throw std::invalid_argument if any of the arguments are invalid or m is too small
+	 * @throw sodiumpp::crypto_error if fails verification
+	 */
+    size_t crypto_secretbox_open(unsigned char *m,size_t mlen,bytes_view c,bytes_view n,bytes_view k);
     /**
      * Generate a new keypair for sign operations.
      * This function was changed from the official NaCl API: it accepts a reference instead of a pointer to sk_string.
      */
     std::string crypto_sign_keypair(std::string &sk_string);
+    void crypto_sign_keypair(unsigned char *pk,size_t pklen,unsigned char *sk,size_t sklen);
     std::string crypto_sign_open(const std::string &sm_string, const std::string &pk_string);
+    /**
+     * Verifies the signed message sm and writes the message to m, which must have room for sm.size() - crypto_sign_BYTES bytes.
+     * Returns the number of bytes written.
+     */
+    size_t crypto_sign_open(unsigned char *m,size_t mlen,bytes_view sm,bytes_view pk);
     std::string crypto_sign(const std::string &m_string, const std::string &sk_string);
+    /**
+     * Signs m and writes the signed message to sm, which must have room for m.size() + crypto_sign_BYTES bytes.
+     * sm may point to the same memory as m.
+     * Returns the number of bytes written.
+     */
+    size_t crypto_sign(unsigned char *sm,size_t smlen,bytes_view m,bytes_view sk);
+    /**
+     * Signs m and returns only the crypto_sign_BYTES bytes signature.
+     */
+    std::string crypto_sign_detached(const std::string &m, const std::string &sk);
+    /**
+     * Signs m and writes the signature to sig, which must have room for crypto_sign_BYTES bytes.
+     * Returns the number of bytes written.
+     */
+    size_t crypto_sign_detached(unsigned char *sig,size_t siglen,bytes_view m,bytes_view sk);
+    void crypto_sign_verify_detached(const std::string &sig, const std::string &m, const std::string &pk);
+    /**
+     * Verifies the detached signature sig of m.
+     * Throws crypto_error if the signature does not have crypto_sign_BYTES bytes or fails verification.
+     */
+    void crypto_sign_verify_detached(bytes_view sig,bytes_view m,bytes_view pk);
+
+    /**
+     * A detached signature sig of the message m under the public key pk, to be checked by crypto_sign_verify_batch.
+     * A signed message sm from crypto_sign is the signature followed by the message: sig is its first crypto_sign_BYTES bytes and m the rest.
+     */
+    struct signature_check {
+        bytes_view m;
+        bytes_view sig;
+        bytes_view pk;
+        signature_check(bytes_view m, bytes_view sig, bytes_view pk) : m(m), sig(sig), pk(pk) {}
+    };
+
+    /**
+     * The outcome of a batch of checks, one bit per check.
+     */
+    class verification_results {
+    private:
+        std::vector<uint64_t> words;
+        size_t count;
+    public:
+        explicit verification_results(size_t count = 0) : words((count + 63) / 64), count(count) {}
+        /**
+         * Returns whether check i passed.
+         */
+        bool operator[](size_t i) const { return (words[i / 64] >> (i % 64)) & 1; }
+        void set(size_t i) { words[i / 64] |= uint64_t(1) << (i % 64); }
+        size_t size() const { return count; }
+        /**
+         * Returns the number of checks that passed.
+         */
+        size_t passed() const;
+        bool all() const { return passed() == count; }
+        /**
+         * Returns the bitmap: bit i % 64 of word i / 64 is set if check i passed.
+         */
+        const std::vector<uint64_t>& bitmap() const { return words; }
+    };
+
+    /**
+     * Verifies every check with crypto_sign_verify_detached, spreading the work over ex if it is not nullptr.
+     * Nothing is thrown for signatures that fail, or for keys and signatures of the wrong length: their bit is simply not set.
+     */
+    verification_results crypto_sign_verify_batch(const std::vector<signature_check>& checks, executor *ex = nullptr);
     std::string crypto_stream(size_t clen,const std::string &n,const std::string &k);
+    /**
+     * Writes clen bytes of keystream to c.
+     */
+    size_t crypto_stream(unsigned char *c,size_t clen,bytes_view n,bytes_view k);
     std::string crypto_stream_xor(const std::string &m,const std::string &n,const std::string &k);
+    /**
+     * Encrypts m and writes the result to c, which must have room for m.size() bytes.
+     * c may point to the same memory as m.
+     * Returns the number of bytes written.
+     */
+    size_t crypto_stream_xor(unsigned char *c,size_t clen,bytes_view m,bytes_view n,bytes_view k);
     std::string crypto_shorthash(const std::string& m, const std::string& k);
+    size_t crypto_shorthash(unsigned char *out, size_t outlen, bytes_view m, bytes_view k);
+    /**
+     * Computes crypto_shorthash with key k of every message in messages, spreading the work over ex if it is not nullptr.
+     * Hash i is written to out + i * crypto_shorthash_BYTES, so out must have room for messages.size() * crypto_shorthash_BYTES bytes.
+     * On CPUs with AVX2 four messages are hashed at once.
+     */
+    void crypto_shorthash_batch(unsigned char *out, size_t outlen, const std::vector<bytes_view>& messages, bytes_view k, executor *ex = nullptr);
 	/**
 	 * @param size size of returned string
 	 * @returns random string
 	 */
     std::string randombytes(size_t size);
 
+    /**
+     * How bin2hex and hex2bin may treat their input.
+     */
+    enum class hex_mode {
+        constant_time, /** The time taken only depends on the length of the input: use this for secrets */
+        fast /** Table lookups and stopping at the first invalid digit are allowed: only use this for public data */
+    };
     /**
      * Encode the binary string bytes to a hexadecimally encoded string, 2 lowercase hexadecimal digits per byte.
      */
-    std::string bin2hex(const std::string& bytes);
+    std::string bin2hex(const std::string& bytes, hex_mode mode = hex_mode::constant_time);
     /**
-     * Decode the hexadecimally encoded string bytes to a binary string, 2 lowercase hexadecimal digits per byte.
+     * Encode bin as 2 lowercase hexadecimal digits per byte into the buffer hex of hexlen bytes, without a terminating nul.
+     * Returns the number of digits written.
      */
-    std::string hex2bin(const std::string& bytes);
+    size_t bin2hex(char *hex, size_t hexlen, bytes_view bin, hex_mode mode = hex_mode::constant_time);
+    /**
+     * Decode the hexadecimally encoded string bytes, 2 upper or lower case hexadecimal digits per byte, to a binary string.
+     * Throws std::invalid_argument if the length is odd or a character is not a hexadecimal digit; the input is validated before the result is allocated.
+     */
+    std::string hex2bin(const std::string& bytes, hex_mode mode = hex_mode::constant_time);
+    /**
+     * Decode the hexadecimal digits in hex into the buffer bin of binlen bytes and return the number of bytes written.
+     * Throws std::invalid_argument like the string version, in which case the output buffer is zeroed.
+     */
+    size_t hex2bin(unsigned char *bin, size_t binlen, bytes_view hex, hex_mode mode = hex_mode::constant_time);
     
     /**
      * Securely erases the contents of the string bytes.
@@ -166,6 +548,58 @@ namespace sodiumpp {
      * Unlocks the memory used by the string bytes, allowing it to be swapped out again.
      */
     void munlock(std::string& bytes);
+    /**
+     * Initializes libsodium if that has not been done yet.
+     * Throws std::runtime_error if libsodium cannot be initialized.
+     */
+    void init();
+
+    /**
+     * Fixed-size storage for N bytes of secret material.
+     *
+     * The bytes live in a slot of the secure_pool, so they are locked in memory
+     * and securely erased when the object is destroyed. Unlike a std::string the storage never moves,
+     * so it is locked before any secret is written to it.
+     * Throws std::bad_alloc if the memory cannot be allocated.
+     */
+    template <size_t N>
+    class locked_bytes {
+    private:
+        static_assert(N <= secure_pool::slot_size, "locked_bytes must fit in a secure_pool slot");
+        unsigned char *ptr;
+    public:
+        /**
+         * Allocate N zeroed bytes.
+         */
+        locked_bytes() : ptr(secure_pool::instance().allocate()) {}
+        /**
+         * Allocate N bytes and copy bytes into them.
+         * Throws std::invalid_argument if bytes does not have length N.
+         */
+        explicit locked_bytes(bytes_view bytes) : locked_bytes() {
+            if(bytes.size() != N) {
+                throw std::invalid_argument("incorrect key length");
+            }
+            std::copy(bytes.begin(), bytes.end(), ptr);
+        }
+        locked_bytes(const locked_bytes<N>& other) : locked_bytes() {
+            std::copy(other.ptr, other.ptr + N, ptr);
+        }
+        locked_bytes<N>& operator=(const locked_bytes<N>& other) {
+            std::copy(other.ptr, other.ptr + N, ptr);
+            return *this;
+        }
+        /**
+         * Erase the bytes and return them to the secure_pool.
+         */
+        ~locked_bytes() {
+            secure_pool::instance().deallocate(ptr);
+        }
+        unsigned char *data() { return ptr; }
+        const unsigned char *data() const { return ptr; }
+        static constexpr size_t size() { return N; }
+        operator bytes_view() const { return bytes_view(ptr, N); }
+    };
     
     /**
      * Exception class for cryptographic errors: failed verifications etc.
@@ -187,33 +621,106 @@ namespace sodiumpp {
     /**
      * Encode binary_bytes to a string of bytes in the specified encoding.
      */
-    std::string encode_from_binary(const std::string& binary_bytes, encoding enc);
+    std::string encode_from_binary(bytes_view binary_bytes, encoding enc);
     /**
      * Decode encoded_bytes to a string of binary bytes, using the specified encoding.
      */
-    std::string decode_to_binary(const std::string& encoded_bytes, encoding enc);
+    std::string decode_to_binary(bytes_view encoded_bytes, encoding enc);
     
 
     /**
      * Holds a string of bytes in a certain encoding.
+     *
+     * An encoded_bytes either owns its bytes, or is a view of bytes owned by the caller (see view()).
+     * The binary form is decoded once and shared between copies; for binary bytes nothing is decoded or copied.
+     * As bytes and enc may be changed, the decoded form of owned bytes keeps a copy of the encoded bytes it was decoded from,
+     * and is decoded again when they differ. Viewed bytes must not change, so for a view only their address, length and enc are checked.
      */
     class encoded_bytes {
+    private:
+        struct decoded_form {
+            encoding enc;
+            bytes_view viewed; /** The viewed bytes that were decoded, if they were viewed */
+            std::string encoded; /** A copy of the owned bytes that were decoded, if they were owned */
+            std::string binary;
+        };
+        bytes_view viewed;
+        bool is_view_;
+        mutable std::shared_ptr<const decoded_form> decoded;
+        encoded_bytes(bytes_view viewed, enum encoding enc) : viewed(viewed), is_view_(true), enc(enc) {}
+        bool decoded_from(const decoded_form& form) const {
+            if(form.enc != enc) {
+                return false;
+            }
+            if(is_view_) {
+                return form.viewed.data() == viewed.data() and form.viewed.size() == viewed.size();
+            }
+            return !form.viewed.data() and bytes == form.encoded;
+        }
     public:
-        std::string bytes; /** The encoded bytes */
+        std::string bytes; /** The encoded bytes, empty if this is a view */
         encoding enc; /** The encoding that was used */
         /**
          * Constructor from a string of bytes that is assumed to be encoded in the specified encoding. 
          */
-        encoded_bytes(const std::string& bytes, enum encoding enc) : bytes(bytes), enc(enc) {}
+        encoded_bytes(const std::string& bytes, enum encoding enc) : is_view_(false), bytes(bytes), enc(enc) {}
+        encoded_bytes(std::string&& bytes, enum encoding enc) : is_view_(false), bytes(std::move(bytes)), enc(enc) {}
+        /**
+         * Returns an encoded_bytes that refers to bytes without copying them.
+         * The bytes must outlive the returned object and all copies of it.
+         */
+        static encoded_bytes view(bytes_view bytes, enum encoding enc) { return encoded_bytes(bytes, enc); }
+        /**
+         * Returns an encoded_bytes that holds binary in the encoding enc, encoding it only if enc is not binary.
+         */
+        static encoded_bytes from_binary(std::string&& binary, enum encoding enc) {
+            return enc == encoding::binary ? encoded_bytes(std::move(binary), enc) : encoded_bytes(encode_from_binary(binary, enc), enc);
+        }
+        /**
+         * Returns whether this object refers to bytes it does not own.
+         */
+        bool is_view() const { return is_view_; }
+        /**
+         * Returns the encoded bytes, whether they are owned or viewed.
+         */
+        bytes_view encoded() const { return is_view_ ? viewed : bytes_view(bytes); }
+        /**
+         * Returns the binary bytes, decoding them if they were not decoded before in this form.
+         * The view is valid until bytes or enc is changed, for as long as this object or a copy of it is alive.
+         * Safe to call from several threads at once, as long as none of them changes the object.
+         */
+        bytes_view binary() const {
+            if(enc == encoding::binary) {
+                return encoded();
+            }
+            std::shared_ptr<const decoded_form> cached = std::atomic_load(&decoded);
+            if(!cached or !decoded_from(*cached)) {
+                std::shared_ptr<const decoded_form> fresh = std::make_shared<const decoded_form>(
+                    is_view_ ? decoded_form{enc, viewed, std::string(), decode_to_binary(viewed, enc)}
+                             : decoded_form{enc, bytes_view(), bytes, decode_to_binary(bytes, enc)});
+                cached = std::atomic_compare_exchange_strong(&decoded, &cached, fresh) ? fresh : cached;
+            }
+            return bytes_view(cached->binary);
+        }
         /**
          * Convenience method for quickly getting the binary string corresponding to the encoded bytes.
          */
-        std::string to_binary() const { return decode_to_binary(bytes, enc); }
+        std::string to_binary() const { return binary().str(); }
         /**
-         * Return a new encoded_bytes object that contains the same data but encoded with new_encoding.
+         * Return an encoded_bytes object that contains the same data but encoded with new_encoding.
+         * If new_encoding is the current encoding this is a copy, which remains a view if this is one.
          */
-        encoded_bytes to(enum encoding new_encoding) {
-            return encoded_bytes(encode_from_binary(to_binary(), new_encoding), new_encoding);
+        encoded_bytes to(enum encoding new_encoding) const {
+            if(new_encoding == enc) {
+                return *this;
+            }
+            bytes_view binary_bytes = binary();
+            encoded_bytes result(encode_from_binary(binary_bytes, new_encoding), new_encoding);
+            if(new_encoding != encoding::binary) {
+                // Copying the binary form is cheaper than decoding it again
+                result.decoded = std::make_shared<const decoded_form>(decoded_form{new_encoding, bytes_view(), result.bytes, binary_bytes.str()});
+            }
+            return result;
         }
     };
     
@@ -247,6 +754,14 @@ namespace sodiumpp {
     };
     
     template <key_purpose P> class secret_key;
+
+    /**
+     * Where the MAC is kept when a message is boxed in place.
+     */
+    enum class mac_position {
+        front, /** The MAC precedes the ciphertext, as in the output of crypto_box */
+        back /** The MAC follows the ciphertext */
+    };
     
     /**
      * Manages a public key.
@@ -260,19 +775,37 @@ namespace sodiumpp {
          * Private default constructor to avoid inproperly constructed public_keys
          */
         public_key() {}
-        std::string bytes; /** The binary encoded bytes of this key */
+        unsigned char bytes[key_lengths<P>::public_key]; /** The binary bytes of this key */
     public:
         const key_purpose purpose = P; /** The purpose of this key */
         /**
          * Construct a public_key from encoded bytes
+         * Throws std::invalid_argument if the decoded bytes do not have length key_lengths<P>::public_key.
          */
-        public_key(const encoded_bytes& bytes) : bytes(bytes.to_binary()) {}
+        public_key(const encoded_bytes& bytes) {
+            bytes_view decoded = bytes.binary();
+            if(decoded.size() != size()) {
+                throw std::invalid_argument("incorrect public-key length");
+            }
+            std::copy(decoded.begin(), decoded.end(), this->bytes);
+        }
         /**
          * Get the encoding encoded bytes of this public_key
          */
-        encoded_bytes get(encoding enc=encoding::binary) const { return encoded_bytes(encode_from_binary(bytes, enc), enc); }
-        bool operator==(const public_key<P>& other) {
-            return bytes == other.bytes;
+        encoded_bytes get(encoding enc=encoding::binary) const { return encoded_bytes(encode_from_binary(bytes_view(bytes, size()), enc), enc); }
+        /**
+         * Returns a pointer to the size() bytes of this key, without copying them.
+         */
+        const unsigned char *data() const { return bytes; }
+        static constexpr size_t size() { return key_lengths<P>::public_key; }
+        bool operator==(const public_key<P>& other) const {
+            return std::equal(bytes, bytes + size(), other.bytes);
+        }
+        /**
+         * Lexicographic order of the bytes of the keys, as used to choose between even and uneven nonces.
+         */
+        bool operator<(const public_key<P>& other) const {
+            return std::lexicographical_compare(bytes, bytes + size(), other.bytes, other.bytes + size());
         }
         friend class secret_key<P>;
     };
@@ -293,14 +826,15 @@ namespace sodiumpp {
      */
     template <key_purpose P>
     class secret_key {
-        std::string secret_bytes;
+        locked_bytes<key_lengths<P>::secret_key> secret_bytes;
     public:
         const key_purpose purpose = P; /** The purpose of this key */
         public_key<P> pk; /**< The public key corresponding to this secret key */
         /**
          * Construct a secret key from a pregenerated public and secret key.
+         * Throws std::invalid_argument if the decoded secret bytes do not have length key_lengths<P>::secret_key.
          */
-        secret_key(const public_key<P>& pk, const encoded_bytes& secret_bytes) : pk(pk), secret_bytes(secret_bytes.to_binary()) {}
+        secret_key(const public_key<P>& pk, const encoded_bytes& secret_bytes) : secret_bytes(secret_bytes.binary()), pk(pk) {}
         /**
          * Copy constructor
          */
@@ -311,28 +845,26 @@ namespace sodiumpp {
          */
         secret_key() {
             if(P == key_purpose::box) {
-                pk.bytes = crypto_box_keypair(secret_bytes);
+                crypto_box_keypair(pk.bytes, pk.size(), secret_bytes.data(), secret_bytes.size());
             } else if(P == key_purpose::sign) {
-                pk.bytes = crypto_sign_keypair(secret_bytes);
+                crypto_sign_keypair(pk.bytes, pk.size(), secret_bytes.data(), secret_bytes.size());
             } else {
                 // Should be caught by the static_assert above
-                std::invalid_argument("purposes other than box and sign are not yet supported");
+                throw std::invalid_argument("purposes other than box and sign are not yet supported");
             }
-            mlock(secret_bytes);
         }
         /**
          * Get the encoded bytes of the secret key.
          */
-        encoded_bytes get(encoding enc=encoding::binary) const { return encoded_bytes(encode_from_binary(secret_bytes, enc), enc); }
+        encoded_bytes get(encoding enc=encoding::binary) const { return encoded_bytes(encode_from_binary(bytes_view(data(), size()), enc), enc); }
         /**
-         * Securely erase and unlock the memory containing the secret key.
+         * Returns a pointer to the size() bytes of the secret key, without copying them.
+         * The pointer is valid for the lifetime of this secret_key.
          */
-        ~secret_key() {
-            memzero(secret_bytes);
-            munlock(secret_bytes);
-        }
-        bool operator==(const secret_key<P>& other) {
-            return secret_bytes.size() == other.secret_bytes.size() and sodium_memcmp(&secret_bytes[0], &(other.secretbytes[0]), secret_bytes.size()) and pk == other.pk;
+        const unsigned char *data() const { return secret_bytes.data(); }
+        static constexpr size_t size() { return key_lengths<P>::secret_key; }
+        bool operator==(const secret_key<P>& other) const {
+            return sodium_memcmp(data(), other.data(), size()) == 0 and pk == other.pk;
         }
     };
     
@@ -346,6 +878,178 @@ namespace sodiumpp {
     typedef secret_key<key_purpose::box> box_secret_key;
     typedef public_key<key_purpose::sign> sign_public_key;
     typedef secret_key<key_purpose::sign> sign_secret_key;
+
+    /**
+     * Keeps a queue of generated keypairs ready, so that taking a new keypair does not wait for its generation.
+     *
+     * Keypairs are generated in ranges of batch keys that are spread over the executor, and kept in a bounded lock-free queue.
+     * Whenever pop() leaves the queue at most half full, the queue is refilled by a task on the executor.
+     * Without an executor the queue is only refilled by fill().
+     * The secret keys live in the secure_pool like any other secret_key.
+     * pop() and size() are lock-free and can be called from many threads at once.
+     * The executor must outlive the factory, and the factory must not be destroyed by a task running on the executor.
+     */
+    template <key_purpose P>
+    class keypair_factory {
+    private:
+        struct cell;
+        std::unique_ptr<cell[]> cells;
+        size_t mask;
+        size_t batch;
+        executor *ex;
+        alignas(64) std::atomic<size_t> push_position;
+        alignas(64) std::atomic<size_t> pop_position;
+        alignas(64) std::atomic<bool> refilling;
+        std::atomic<bool> stopping;
+        std::atomic<uint64_t> miss_count;
+        bool push(secret_key<P> *sk);
+        secret_key<P> *try_pop();
+        void refill();
+    public:
+        /**
+         * Construct a factory that keeps at least capacity keypairs ready, generating batch of them per range,
+         * and start filling it on ex if ex is not nullptr.
+         * Throws std::invalid_argument if capacity or batch is 0.
+         */
+        explicit keypair_factory(size_t capacity = 1024, executor *ex = nullptr, size_t batch = 64);
+        keypair_factory(const keypair_factory<P>&) = delete;
+        keypair_factory<P>& operator=(const keypair_factory<P>&) = delete;
+        /**
+         * Wait for a running refill to stop, and erase the keypairs that were not taken.
+         */
+        ~keypair_factory();
+        /**
+         * Returns a keypair that was not handed out before: from the queue if possible, and otherwise generated by the calling thread.
+         */
+        std::unique_ptr<secret_key<P>> pop();
+        /**
+         * Generate keypairs until the queue is full, using the executor if there is one, and return when they are ready.
+         */
+        void fill();
+        /**
+         * Returns the number of keypairs in the queue. Other threads may change it at any time.
+         */
+        size_t size() const;
+        /**
+         * Returns the number of keypairs the queue can hold.
+         */
+        size_t capacity() const { return mask + 1; }
+        /**
+         * Returns the number of calls to pop() that found the queue empty.
+         */
+        uint64_t misses() const { return miss_count.load(std::memory_order_relaxed); }
+    };
+
+    typedef keypair_factory<key_purpose::box> box_keypair_factory;
+    typedef keypair_factory<key_purpose::sign> sign_keypair_factory;
+
+    /**
+     * Creates detached signatures with a sign_secret_key, without copying the message.
+     *
+     * Besides signing messages in one go, a signer can sign a message that is passed in parts to update(),
+     * for messages that do not fit in memory. Such signatures use Ed25519ph, the pre-hashed variant of Ed25519:
+     * they are only accepted by verifier::final(), and not by verify().
+     */
+    class signer {
+    private:
+        sign_secret_key sk;
+        crypto_sign_state state;
+    public:
+        explicit signer(const sign_secret_key& sk);
+        /**
+         * Returns the public key that verifies the signatures.
+         */
+        const sign_public_key& public_key() const { return sk.pk; }
+        /**
+         * Signs m and writes the crypto_sign_BYTES bytes signature to sig. Returns the number of bytes written.
+         */
+        size_t sign(unsigned char *sig, size_t siglen, bytes_view m) const;
+        std::string sign(bytes_view m) const;
+        /**
+         * Appends m to the message that is signed with Ed25519ph by final().
+         */
+        signer& update(bytes_view m);
+        /**
+         * Writes the Ed25519ph signature of the message passed to update() to sig, and starts a new message.
+         * Returns the number of bytes written.
+         */
+        size_t final(unsigned char *sig, size_t siglen);
+        std::string final();
+    };
+
+    /**
+     * Verifies detached signatures with a sign_public_key, without copying the message.
+     * Messages passed in parts to update() are verified by final() against Ed25519ph signatures from signer::final().
+     */
+    class verifier {
+    private:
+        sign_public_key pk;
+        crypto_sign_state state;
+    public:
+        explicit verifier(const sign_public_key& pk);
+        const sign_public_key& public_key() const { return pk; }
+        /**
+         * Returns whether sig is a valid signature of m.
+         */
+        bool check(bytes_view sig, bytes_view m) const;
+        /**
+         * Throws crypto_error if sig is not a valid signature of m.
+         */
+        void verify(bytes_view sig, bytes_view m) const;
+        /**
+         * Appends m to the message that is verified by final().
+         */
+        verifier& update(bytes_view m);
+        /**
+         * Verifies the Ed25519ph signature sig of the message passed to update(), and starts a new message.
+         * Throws crypto_error if sig is not a valid signature.
+         */
+        void final(bytes_view sig);
+    };
+
+    /**
+     * Cache of crypto_box_beforenm parameters, so that boxers and unboxers for a pair of keys
+     * that was seen before skip the scalar multiplication.
+     *
+     * Entries are indexed by a keyed BLAKE2b hash of the public key and the secret key, the key being random for each cache,
+     * and evicted with the CLOCK algorithm once capacity entries are in use.
+     * The cached parameters are kept in locked memory from the secure_pool and erased on eviction.
+     * The cache is split into independently locked shards, so it can be used from many threads at once.
+     */
+    class shared_key_cache {
+    private:
+        struct shard;
+        locked_bytes<crypto_generichash_KEYBYTES> tag_key;
+        std::vector<std::unique_ptr<shard>> shards;
+        std::atomic<uint64_t> hit_count;
+        std::atomic<uint64_t> miss_count;
+    public:
+        /**
+         * Construct a cache that holds at least capacity parameters.
+         * Throws std::invalid_argument if capacity is 0.
+         */
+        explicit shared_key_cache(size_t capacity = 1024);
+        shared_key_cache(const shared_key_cache&) = delete;
+        shared_key_cache& operator=(const shared_key_cache&) = delete;
+        ~shared_key_cache();
+        /**
+         * Write the crypto_box_beforenm parameter for pk and sk to the crypto_box_BEFORENMBYTES bytes at k,
+         * from the cache if possible and otherwise by computing and caching it.
+         */
+        void beforenm(unsigned char *k, const box_public_key& pk, const box_secret_key& sk);
+        /**
+         * Returns the number of parameters the cache can hold.
+         */
+        size_t capacity() const;
+        /**
+         * Returns the number of calls to beforenm() that were answered from the cache.
+         */
+        uint64_t hits() const { return hit_count.load(std::memory_order_relaxed); }
+        /**
+         * Returns the number of calls to beforenm() that computed the parameter.
+         */
+        uint64_t misses() const { return miss_count.load(std::memory_order_relaxed); }
+    };
     
     /**
      * Nonce type that consists of a constant part and a sequential part that can be incremented.
@@ -359,9 +1063,25 @@ namespace sodiumpp {
     class nonce {
     private:
         /** The current bytes of this nonce, it consists of the constant bytes followed by the sequential bytes in big-endian format. */
-        std::string bytes;  
+        unsigned char bytes[crypto_box_NONCEBYTES];
         /** Indicates an overflow of the sequential part of the nonce if true. */
         bool overflow; 
+        /** The number of trailing bytes of the sequential part that are incremented as one 64-bit integer */
+        static const unsigned int lowbytes = sequentialbytes < 8 ? sequentialbytes : 8;
+
+        uint64_t load_low() const {
+            uint64_t low = 0;
+            for(unsigned int i = crypto_box_NONCEBYTES - lowbytes; i < crypto_box_NONCEBYTES; ++i) {
+                low = (low << 8) | bytes[i];
+            }
+            return low;
+        }
+        void store_low(uint64_t low) {
+            for(unsigned int i = crypto_box_NONCEBYTES; i > crypto_box_NONCEBYTES - lowbytes; --i) {
+                bytes[i-1] = low & 0xff;
+                low >>= 8;
+            }
+        }
     public:
         /** The number of bytes allocated to the constant part */
         static const unsigned int constantbytes = crypto_box_NONCEBYTES-sequentialbytes; 
@@ -377,20 +1097,20 @@ namespace sodiumpp {
          * Throws std::invalid_argument if constant does not have the correct length.
          * If uneven is true the sequential part of the generated nonces will always be uneven (odd, not divisible by 2), otherwise the sequential part will always be even (divisible by 2).
          */
-        nonce(const encoded_bytes& constant, bool uneven, bool generate_constant=true) : bytes(crypto_box_NONCEBYTES, 0), overflow(false) {
-            std::string constant_decoded = constant.to_binary();
+        nonce(const encoded_bytes& constant, bool uneven, bool generate_constant=true) : bytes(), overflow(false) {
+            bytes_view constant_decoded = constant.binary();
             if(constant_decoded.size() == 0) {
                 if(generate_constant) {
-                    randombytes_buf(&bytes[0], constantbytes);
+                    randombytes_buf(bytes, constantbytes);
                 }
             } else if(constant_decoded.size() != constantbytes) {
                 throw std::invalid_argument("constant bytes does not have correct length");
             }
             
-            std::copy(constant_decoded.begin(), constant_decoded.end(), &bytes[0]);
+            std::copy(constant_decoded.begin(), constant_decoded.end(), bytes);
             
             if(uneven) {
-                bytes[bytes.size()-1] = 1;
+                bytes[crypto_box_NONCEBYTES-1] = 1;
             }
         }
         /**
@@ -398,37 +1118,59 @@ namespace sodiumpp {
          * Throws std::invalid_argument if constant and/or sequentialpart do not have the correct number of decoded bytes.
          */
         nonce(const encoded_bytes& constant, const encoded_bytes& sequentialpart) : overflow(false) {
-            std::string constant_decoded = constant.to_binary();
+            bytes_view constant_decoded = constant.binary();
             if(constant_decoded.size() != constantbytes) {
                 throw std::invalid_argument("incorrect number of decoded bytes in constant");
             }
-            std::string sequentialpart_decoded = sequentialpart.to_binary();
+            bytes_view sequentialpart_decoded = sequentialpart.binary();
             if(sequentialpart_decoded.size() != sequentialbytes) {
                 throw std::invalid_argument("incorrect number of decoded bytes in sequential part");
             }
-            bytes = constant_decoded + sequentialpart_decoded;
+            std::copy(constant_decoded.begin(), constant_decoded.end(), bytes);
+            std::copy(sequentialpart_decoded.begin(), sequentialpart_decoded.end(), bytes + constantbytes);
         }
         /**
          * Construct from encoded nonce.
          * Throws std::invalid_argument if the number of decoded bytes is not crypto_box_NONCEBYTES.
          */
-        nonce(const encoded_bytes& encoded) {
-            std::string decoded = encoded.to_binary();
+        nonce(const encoded_bytes& encoded) : overflow(false) {
+            bytes_view decoded = encoded.binary();
             if(decoded.size() != crypto_box_NONCEBYTES) {
                 throw std::invalid_argument("incorrect number of decoded bytes");
             }
-            bytes = decoded;
+            std::copy(decoded.begin(), decoded.end(), bytes);
         }
         /**
          * Increment the sequential part of the nonce by 2.
          * This function does NOT throw an exception on overflow, but delays this until an attempt is made to read the sequential part.
          */
         void increment() {
-            unsigned int carry = 2;
-            for(int64_t i = bytes.size()-1; i >= constantbytes && carry > 0; --i) {
-                unsigned int current = *reinterpret_cast<unsigned char *>(&bytes[i]);
-                current += carry;
-                *reinterpret_cast<unsigned char *>(&bytes[i]) = current & 0xff;
+            increment(1);
+        }
+        /**
+         * Increment the sequential part of the nonce by 2 * count, as if increment() was called count times.
+         * This function does NOT throw an exception on overflow, but delays this until an attempt is made to read the sequential part.
+         */
+        void increment(uint64_t count) {
+            uint64_t low = load_low();
+            if(sequentialbytes < 8) {
+                uint64_t max = (uint64_t(1) << (8 * lowbytes)) - 1;
+                if(count > (max - low) / 2) {
+                    overflow = true;
+                }
+                store_low(low + 2 * count);
+                return;
+            }
+            // Add count twice so that 2 * count cannot overflow, carrying into the bytes before the last 8
+            unsigned int carry = 0;
+            for(int i = 0; i < 2; ++i) {
+                low += count;
+                if(low < count) ++carry;
+            }
+            store_low(low);
+            for(unsigned int i = crypto_box_NONCEBYTES - lowbytes; i > constantbytes && carry > 0; --i) {
+                unsigned int current = bytes[i-1] + carry;
+                bytes[i-1] = current & 0xff;
                 carry = current >> 8;
             }
             if(carry > 0) {
@@ -448,27 +1190,34 @@ namespace sodiumpp {
          * Throws std::overflow_error if an overflow occurred during a previous increment.
          */
         encoded_bytes get(encoding enc=encoding::binary) const {
+            return encoded_bytes(encode_from_binary(bytes_view(data(), crypto_box_NONCEBYTES), enc), enc);
+        }
+        /**
+         * Returns a pointer to the crypto_box_NONCEBYTES bytes of the current value of the nonce, without copying them.
+         * The pointer is invalidated when the nonce is modified or destroyed.
+         * Throws std::overflow_error if an overflow occurred during a previous increment.
+         */
+        const unsigned char *data() const {
             if(overflow) {
                 throw std::overflow_error("Sequential part of nonce has overflowed");
-            } else {
-                return encoded_bytes(encode_from_binary(bytes, enc), enc);
             }
+            return bytes;
         }
         /**
          * Returns the value of the constant part of the nonce in the specified encoding.
          */
         encoded_bytes get_constant(encoding enc=encoding::binary) const { 
-            return encoded_bytes(encode_from_binary(bytes.substr(0, constantbytes), enc), enc); 
+            return encoded_bytes(encode_from_binary(bytes_view(bytes, constantbytes), enc), enc); 
         }
         /**
          * Returns the current value of the sequential part of the nonce in the specified encoding.
          * Throws std::overflow_error if an overflow occurred during a previous increment.
          */
         encoded_bytes get_sequential(encoding enc=encoding::binary) const { 
-            return encoded_bytes(get(encoding::binary).bytes.substr(constantbytes, sequentialbytes), enc); 
+            return encoded_bytes(encode_from_binary(bytes_view(data() + constantbytes, sequentialbytes), enc), enc); 
         }
-        bool operator==(const nonce<sequentialbytes>& other) {
-            return bytes == other.bytes and overflow == other.overflow;
+        bool operator==(const nonce<sequentialbytes>& other) const {
+            return std::equal(bytes, bytes + crypto_box_NONCEBYTES, other.bytes) and overflow == other.overflow;
         }
     };
 
@@ -477,12 +1226,44 @@ namespace sodiumpp {
     typedef nonce<4> nonce32;
     typedef nonce<2> nonce16;
 
+    static_assert(std::is_trivially_copyable<nonce64>::value, "nonces must be cheap to copy");
+
     template <unsigned int sequentialbytes>
     std::ostream& operator<<(std::ostream& s, nonce<sequentialbytes> n) {
-        s << bin2hex(n.constant()) << " - " << bin2hex(n.sequential());
+        s << n.get_constant(encoding::hex).bytes << " - " << n.get_sequential(encoding::hex).bytes;
         return s;
     }
     
+    /**
+     * Boxes messages with consecutive nonces starting at first_n, using the crypto_box_beforenm parameter k,
+     * and spreading the work over the executor ex if it is not nullptr.
+     * The boxed messages are written one after the other to out, and offsets receives messages.size() + 1 entries:
+     * boxed message i is out.substr(offsets[i], offsets[i+1] - offsets[i]) and was boxed with nonce first_n incremented i times.
+     * The caller is responsible for checking that none of the nonces overflow.
+     */
+    template <typename noncetype>
+    void box_batch_afternm(const std::vector<bytes_view>& messages, std::string& out, std::vector<size_t>& offsets,
+                           const noncetype& first_n, bytes_view k, executor *ex) {
+        offsets.resize(messages.size() + 1);
+        offsets[0] = 0;
+        for(size_t i = 0; i < messages.size(); ++i) {
+            offsets[i+1] = offsets[i] + messages[i].size() + crypto_box_MACBYTES;
+        }
+        out.resize(offsets.back());
+        // Aim for ranges of about 64 KiB of output so small messages are not scheduled one by one
+        size_t grain = messages.empty() ? 1 : 1 + (64 * 1024) / (1 + offsets.back() / messages.size());
+        unsigned char *out_bytes = reinterpret_cast<unsigned char *>(&out[0]);
+        parallel_for(ex, messages.size(), grain, [&](size_t begin, size_t end){
+            noncetype current_n = first_n;
+            current_n.increment(begin);
+            for(size_t i = begin; i < end; ++i) {
+                crypto_box_afternm(out_bytes + offsets[i], offsets[i+1] - offsets[i],
+                                   messages[i], bytes_view(current_n.data(), crypto_box_NONCEBYTES), k);
+                current_n.increment();
+            }
+        });
+    }
+
     /**
      * Boxer suppots both public-key crypto and symmetric crypto - it has two possible uses:
      * 1)
@@ -515,7 +1296,7 @@ namespace sodiumpp {
     class boxer {
     private:
         noncetype n;
-        const std::string k;
+        locked_bytes<crypto_box_BEFORENMBYTES> k;
     public:
     		struct boxer_type_shared_key{}; // just a tag, to "name" the constructor
 
@@ -527,23 +1308,33 @@ namespace sodiumpp {
          * Construct from the receiver's public key pk, the sender's secret key sk and an encoded constant part for the nonces.
          *
          */
-        boxer(const box_public_key& pk, const box_secret_key& sk, const encoded_bytes& nonce_constant) : k(std::move(crypto_box_beforenm(pk.get().to_binary(), sk.get().to_binary()))), n(nonce_constant, sk.pk.get().to_binary() > pk.get().to_binary()) {
+        boxer(const box_public_key& pk, const box_secret_key& sk, const encoded_bytes& nonce_constant) : n(nonce_constant, pk < sk.pk) {
+            crypto_box_beforenm(k.data(), k.size(), bytes_view(pk.data(), pk.size()), bytes_view(sk.data(), sk.size()));
+        }
+        /**
+         * Construct from the receiver's public key pk, the sender's secret key sk and an encoded constant part for the nonces,
+         * taking the crypto_box_beforenm parameter from cache.
+         */
+        boxer(const box_public_key& pk, const box_secret_key& sk, const encoded_bytes& nonce_constant, shared_key_cache& cache) : n(nonce_constant, pk < sk.pk) {
+            cache.beforenm(k.data(), pk, sk);
         }
+        /**
+         * Construct from the receiver's public key pk and the sender's secret key sk,
+         * taking the crypto_box_beforenm parameter from cache.
+         */
+        boxer(const box_public_key& pk, const box_secret_key& sk, shared_key_cache& cache) : boxer(pk, sk, encoded_bytes("", encoding::binary), cache) {}
         /**
          * Construct from the secret shared-key. You must make sure that one side of connection
          * calls this with use nonce_is_even==true and other with ==false, otherwise this will be insecure!
          * (though we hope such case would be detecte/asserted by recipient, so it should come up in testing)
          */
-        boxer(boxer_type_shared_key &, bool use_nonce_even, const encoded_bytes& secret_shared_key,
+        boxer(const boxer_type_shared_key &, bool use_nonce_even, const encoded_bytes& secret_shared_key,
         	const encoded_bytes& nonce_constant)
-        // TODO: make sure the k is mlock'ed before it is initialized with a value
-        : k(secret_shared_key.to_binary()),
-        n( nonce_constant , use_nonce_even )
-        {
-        	mlock(k);
-      	}
-
-        boxer(boxer_type_shared_key &, bool use_nonce_even, const encoded_bytes& secret_shared_key)
+        : n( nonce_constant , use_nonce_even ),
+        k(secret_shared_key.binary())
+        {	}
+
+        boxer(const boxer_type_shared_key &, bool use_nonce_even, const encoded_bytes& secret_shared_key)
         : boxer( boxer_type_shared_key() , use_nonce_even , secret_shared_key,  encoded_bytes("", encoding::binary) )
         {	}
 
@@ -560,30 +1351,186 @@ namespace sodiumpp {
          * Automatically increments the nonce after each message.
          * The nonce that was used will be put in used_n.
          */
-        encoded_bytes box(std::string message, noncetype& used_n, encoding enc=encoding::binary) {
-            std::string c = crypto_box_afternm(message, n.get().to_binary(), k);
+        encoded_bytes box(const std::string& message, noncetype& used_n, encoding enc=encoding::binary) {
+            std::string c(message.size() + crypto_box_MACBYTES, 0);
+            crypto_box_afternm((unsigned char *)&c[0], c.size(), message, bytes_view(n.data(), crypto_box_NONCEBYTES), k);
             used_n = n;
             n.increment();
-            return encoded_bytes(encode_from_binary(c, enc), enc);
+            return encoded_bytes::from_binary(std::move(c), enc);
         }
         /**
          * Box the message m and return the boxed message in the specified encoding.
          * Automatically increments the nonce after each message.
          */
-        encoded_bytes box(std::string message, encoding enc=encoding::binary) {
+        encoded_bytes box(const std::string& message, encoding enc=encoding::binary) {
             noncetype current_n;
             return box(message, current_n, enc);
         }
         /**
-         * Securely erase the crypto_box_afternm parameter,
-         * and unlock the memory that contained it.
+         * Box the message of mlen bytes in buf in place, buf must have room for mlen + crypto_box_MACBYTES bytes.
+         * With mac_position::front the message must start at buf + crypto_box_MACBYTES, and afterwards buf holds
+         * the same bytes box() would have returned.
+         * With mac_position::back the message must start at buf, and the MAC is written at buf + mlen.
+         * Automatically increments the nonce after each message.
+         * The nonce that was used will be put in used_n.
+         */
+        void box_inplace(unsigned char *buf, size_t mlen, noncetype& used_n, mac_position pos=mac_position::front) {
+            bytes_view nonce_bytes(n.data(), crypto_box_NONCEBYTES);
+            if(pos == mac_position::front) {
+                crypto_box_afternm(buf, mlen + crypto_box_MACBYTES, bytes_view(buf + crypto_box_MACBYTES, mlen), nonce_bytes, k);
+            } else {
+                crypto_box_detached_afternm(buf, buf + mlen, bytes_view(buf, mlen), nonce_bytes, k);
+            }
+            used_n = n;
+            n.increment();
+        }
+        /**
+         * Box a batch of messages with consecutive nonces.
+         * The boxed messages are written one after the other to out, and offsets receives messages.size() + 1 entries:
+         * boxed message i is out.substr(offsets[i], offsets[i+1] - offsets[i]) and was boxed with nonce first_n incremented i times.
+         * The nonce is checked for overflow once for the whole batch: if it would overflow, std::overflow_error
+         * is thrown before anything is boxed and the current nonce is left as-is.
          */
-        ~boxer() {
-            memzero(k);
-            munlock(k);
+        void box_batch(const std::vector<bytes_view>& messages, std::string& out, std::vector<size_t>& offsets, noncetype& first_n) {
+            box_batch(messages, out, offsets, first_n, nullptr);
+        }
+        /**
+         * Box a batch of messages with consecutive nonces, see box_batch above.
+         */
+        void box_batch(const std::vector<bytes_view>& messages, std::string& out, std::vector<size_t>& offsets) {
+            noncetype first_n;
+            box_batch(messages, out, offsets, first_n, nullptr);
+        }
+        /**
+         * Box a batch of messages with consecutive nonces, spreading the work over the executor ex.
+         * The nonce range for the whole batch is reserved up front, so the output is identical to that of the serial box_batch.
+         * If ex is nullptr the messages are boxed on the calling thread.
+         */
+        void box_batch(const std::vector<bytes_view>& messages, std::string& out, std::vector<size_t>& offsets, noncetype& first_n, executor *ex) {
+            noncetype next_n = n;
+            next_n.increment(messages.size());
+            if(messages.size() > 0) {
+                noncetype last_n = n;
+                last_n.increment(messages.size() - 1);
+                last_n.data(); // throws std::overflow_error if the batch does not fit in the sequential part
+            }
+            box_batch_afternm(messages, out, offsets, n, k, ex);
+            first_n = n;
+            n = next_n;
+        }
+        /**
+         * Box the message of mlen bytes in buf in place, see box_inplace above.
+         * Automatically increments the nonce after each message.
+         */
+        void box_inplace(unsigned char *buf, size_t mlen, mac_position pos=mac_position::front) {
+            noncetype current_n;
+            box_inplace(buf, mlen, current_n, pos);
         }
     };
     
+    /**
+     * Boxer that can be shared between threads without a lock.
+     *
+     * Boxes a series of messages between sender's secret key and a receiver's public key, like boxer.
+     * Instead of incrementing a nonce, threads claim single nonces or blocks of consecutive nonces from an atomic counter,
+     * so every claimed nonce is used exactly once no matter how the threads interleave.
+     * A claim for more nonces than are left before the sequential part of the nonce overflows throws std::overflow_error
+     * and claims nothing, so a later, smaller claim that still fits succeeds.
+     *
+     * The template parameter noncetype specifies the type of nonce that should be used, as for boxer.
+     * The unboxer must be given the nonce that was used for each message, as the order in which
+     * messages are boxed by different threads is not defined.
+     */
+    template <typename noncetype>
+    class concurrent_boxer {
+    private:
+        /** The nonce that is used for claim 0 */
+        const noncetype first_n;
+        locked_bytes<crypto_box_BEFORENMBYTES> k;
+        /** The number of nonces that can be claimed before the sequential part overflows */
+        const uint64_t capacity;
+        std::atomic<uint64_t> claimed;
+
+        static uint64_t nonces_until_overflow(const noncetype& n) {
+            const unsigned char *bytes = n.data();
+            const unsigned int sequentialbytes = crypto_box_NONCEBYTES - noncetype::constantbytes;
+            uint64_t low = 0;
+            for(unsigned int i = crypto_box_NONCEBYTES - std::min(sequentialbytes, 8u); i < crypto_box_NONCEBYTES; ++i) {
+                low = (low << 8) | bytes[i];
+            }
+            for(unsigned int i = noncetype::constantbytes; i + 8 < crypto_box_NONCEBYTES; ++i) {
+                // A byte above the low 8 can still be incremented, so at least 2^63 nonces are left
+                // (each claim advances the nonce by 2): more than the claim counter can count
+                if(bytes[i] != 0xff) return UINT64_MAX;
+            }
+            uint64_t max = sequentialbytes >= 8 ? UINT64_MAX : (uint64_t(1) << (8 * sequentialbytes)) - 1;
+            return (max - low) / 2 + 1;
+        }
+    public:
+        /**
+         * Construct from the receiver's public key pk and the sender's secret key sk.
+         */
+        concurrent_boxer(const box_public_key& pk, const box_secret_key& sk) : concurrent_boxer(pk, sk, encoded_bytes("", encoding::binary)) {}
+        /**
+         * Construct from the receiver's public key pk, the sender's secret key sk and an encoded constant part for the nonces.
+         */
+        concurrent_boxer(const box_public_key& pk, const box_secret_key& sk, const encoded_bytes& nonce_constant)
+        : first_n(nonce_constant, pk < sk.pk),
+          capacity(nonces_until_overflow(first_n)), claimed(0) {
+            crypto_box_beforenm(k.data(), k.size(), bytes_view(pk.data(), pk.size()), bytes_view(sk.data(), sk.size()));
+        }
+        /**
+         * Construct from the receiver's public key pk, the sender's secret key sk and an encoded constant part for the nonces,
+         * taking the crypto_box_beforenm parameter from cache.
+         */
+        concurrent_boxer(const box_public_key& pk, const box_secret_key& sk, const encoded_bytes& nonce_constant, shared_key_cache& cache)
+        : first_n(nonce_constant, pk < sk.pk),
+          capacity(nonces_until_overflow(first_n)), claimed(0) {
+            cache.beforenm(k.data(), pk, sk);
+        }
+        concurrent_boxer(const concurrent_boxer&) = delete;
+        concurrent_boxer& operator=(const concurrent_boxer&) = delete;
+        /**
+         * Convenience method to get the constant part of the nonce.
+         */
+        encoded_bytes get_nonce_constant(encoding enc=encoding::binary) const { return first_n.get_constant(enc); }
+        /**
+         * Claim count consecutive nonces and return the first one.
+         * The nonces are the returned nonce incremented 0 to count - 1 times.
+         * Throws std::overflow_error if fewer than count nonces are left.
+         */
+        noncetype reserve(uint64_t count = 1) {
+            uint64_t first = claimed.load(std::memory_order_relaxed);
+            do {
+                if(count > capacity - first) {
+                    throw std::overflow_error("Sequential part of nonce has overflowed");
+                }
+            } while(!claimed.compare_exchange_weak(first, first + count, std::memory_order_relaxed));
+            noncetype n = first_n;
+            n.increment(first);
+            return n;
+        }
+        /**
+         * Box the message m with a newly claimed nonce and return the boxed message in the specified encoding.
+         * The nonce that was used will be put in used_n.
+         */
+        encoded_bytes box(const std::string& message, noncetype& used_n, encoding enc=encoding::binary) {
+            used_n = reserve();
+            std::string c(message.size() + crypto_box_MACBYTES, 0);
+            crypto_box_afternm((unsigned char *)&c[0], c.size(), message, bytes_view(used_n.data(), crypto_box_NONCEBYTES), k);
+            return encoded_bytes::from_binary(std::move(c), enc);
+        }
+        /**
+         * Box a batch of messages with a block of consecutive nonces claimed at once, see boxer::box_batch.
+         * If ex is not nullptr the work is spread over it.
+         */
+        void box_batch(const std::vector<bytes_view>& messages, std::string& out, std::vector<size_t>& offsets, noncetype& first_n, executor *ex = nullptr) {
+            noncetype batch_n = reserve(messages.size());
+            box_batch_afternm(messages, out, offsets, batch_n, k, ex);
+            first_n = batch_n;
+        }
+    };
+
     /**
      * Unboxer suppots both public-key crypto and symmetric crypto - it has two possible uses:
      * 1)
@@ -606,26 +1553,30 @@ namespace sodiumpp {
     class unboxer {
     private:
         noncetype n;
-        std::string k;
+        locked_bytes<crypto_box_BEFORENMBYTES> k;
     public:
     		struct boxer_type_shared_key{}; // just a tag, to "name" the constructor
 
         /**
          * Construct from the sender's public key pk, the receiver's secret key sk and an encoded constant part for the nonces.
          */
-        unboxer(const box_public_key& pk, const box_secret_key& sk, const encoded_bytes& nonce_constant) : k(crypto_box_beforenm(pk.get().to_binary(), sk.get().to_binary())), n(nonce_constant, pk.get().to_binary() > sk.pk.get().to_binary()) {
-            mlock(k);
+        unboxer(const box_public_key& pk, const box_secret_key& sk, const encoded_bytes& nonce_constant) : n(nonce_constant, sk.pk < pk) {
+            crypto_box_beforenm(k.data(), k.size(), bytes_view(pk.data(), pk.size()), bytes_view(sk.data(), sk.size()));
+        }
+        /**
+         * Construct from the sender's public key pk, the receiver's secret key sk and an encoded constant part for the nonces,
+         * taking the crypto_box_beforenm parameter from cache.
+         */
+        unboxer(const box_public_key& pk, const box_secret_key& sk, const encoded_bytes& nonce_constant, shared_key_cache& cache) : n(nonce_constant, sk.pk < pk) {
+            cache.beforenm(k.data(), pk, sk);
         }
         /**
         * Construct from the secret shared-key, and possibly with using a nonce_constant.
         */
-        unboxer(boxer_type_shared_key &, bool use_nonce_even, const encoded_bytes& secret_shared_key,
+        unboxer(const boxer_type_shared_key &, bool use_nonce_even, const encoded_bytes& secret_shared_key,
         	const encoded_bytes& nonce_constant) :
-        // TODO: make sure the k is mlock'ed before it is initialized with a value
-        	k(secret_shared_key.to_binary()), n(nonce_constant, use_nonce_even)
-        {
-            mlock(k);
-        }
+        	n(nonce_constant, use_nonce_even), k(secret_shared_key.binary())
+        {	}
         /**
          * Returns the current nonce.
          */
@@ -639,7 +1590,9 @@ namespace sodiumpp {
          * Automatically increments the nonce after each message.
          */
         std::string unbox(const encoded_bytes& ciphertext) {
-            std::string m = crypto_box_open_afternm(ciphertext.to_binary(), n.get().to_binary(), k);
+            bytes_view c = ciphertext.binary();
+            std::string m(c.size() < crypto_box_MACBYTES ? 0 : c.size() - crypto_box_MACBYTES, 0);
+            crypto_box_open_afternm((unsigned char *)&m[0], m.size(), c, bytes_view(n.data(), crypto_box_NONCEBYTES), k);
             n.increment();
             return m;
         }
@@ -648,17 +1601,197 @@ namespace sodiumpp {
          * Does NOT use or change the current nonce, but uses the nonce in n_override instead.
          */
         std::string unbox(const encoded_bytes& ciphertext, const noncetype& n_override) const {
-            std::string m = crypto_box_open_afternm(ciphertext.to_binary(), n_override.get().to_binary(), k);
+            bytes_view c = ciphertext.binary();
+            std::string m(c.size() < crypto_box_MACBYTES ? 0 : c.size() - crypto_box_MACBYTES, 0);
+            crypto_box_open_afternm((unsigned char *)&m[0], m.size(), c, bytes_view(n_override.data(), crypto_box_NONCEBYTES), k);
             return m;
         }
         /**
-         * Securely erase the crypto_box_afternm parameter,
-         * and unlock the memory that contained it.
+         * Unbox the boxed message of clen bytes in buf in place and return the length of the unboxed message.
+         * With mac_position::front buf must hold the bytes returned by boxer::box(), and the message is written at buf + crypto_box_MACBYTES.
+         * With mac_position::back the MAC must be the last crypto_box_MACBYTES bytes of buf, and the message is written at buf.
+         * Automatically increments the nonce after each message.
+         * Throws crypto_error and leaves buf unchanged if the ciphertext fails verification.
          */
-        ~unboxer() {
-            memzero(k);
-            munlock(k);
+        size_t unbox_inplace(unsigned char *buf, size_t clen, mac_position pos=mac_position::front) {
+            size_t mlen = unbox_inplace(buf, clen, n, pos);
+            n.increment();
+            return mlen;
         }
+        /**
+         * Unbox the boxed message of clen bytes in buf in place and return the length of the unboxed message.
+         * Does NOT use or change the current nonce, but uses the nonce in n_override instead.
+         */
+        size_t unbox_inplace(unsigned char *buf, size_t clen, const noncetype& n_override, mac_position pos=mac_position::front) const {
+            bytes_view nonce_bytes(n_override.data(), crypto_box_NONCEBYTES);
+            if(pos == mac_position::front) {
+                return crypto_box_open_afternm(buf + crypto_box_MACBYTES, clen, bytes_view(buf, clen), nonce_bytes, k);
+            } else {
+                if(clen < crypto_box_MACBYTES) throw crypto_error("ciphertext too short");
+                return crypto_box_open_detached_afternm(buf, bytes_view(buf, clen - crypto_box_MACBYTES), bytes_view(buf + clen - crypto_box_MACBYTES, crypto_box_MACBYTES), nonce_bytes, k);
+            }
+        }
+        /**
+         * Unbox a batch of boxed messages that were boxed with consecutive nonces, e.g. by boxer::box_batch.
+         * The unboxed messages are written one after the other to out, and offsets receives ciphertexts.size() + 1 entries:
+         * unboxed message i is out.substr(offsets[i], offsets[i+1] - offsets[i]).
+         * Automatically increments the nonce once for every message, but only if all of them could be unboxed.
+         * Throws crypto_error if any of the ciphertexts fails verification, the contents of out are unspecified in that case.
+         */
+        void unbox_batch(const std::vector<bytes_view>& ciphertexts, std::string& out, std::vector<size_t>& offsets) {
+            unbox_batch(ciphertexts, out, offsets, n);
+            n.increment(ciphertexts.size());
+        }
+        /**
+         * Unbox a batch of boxed messages that were boxed with consecutive nonces starting at first_n.
+         * Does NOT use or change the current nonce.
+         */
+        void unbox_batch(const std::vector<bytes_view>& ciphertexts, std::string& out, std::vector<size_t>& offsets, const noncetype& first_n) const {
+            offsets.resize(ciphertexts.size() + 1);
+            offsets[0] = 0;
+            for(size_t i = 0; i < ciphertexts.size(); ++i) {
+                if(ciphertexts[i].size() < crypto_box_MACBYTES) throw crypto_error("ciphertext too short");
+                offsets[i+1] = offsets[i] + ciphertexts[i].size() - crypto_box_MACBYTES;
+            }
+            if(ciphertexts.size() > 0) {
+                noncetype last_n = first_n;
+                last_n.increment(ciphertexts.size() - 1);
+                last_n.data(); // throws std::overflow_error if the batch does not fit in the sequential part
+            }
+            out.resize(offsets.back());
+            noncetype current_n = first_n;
+            for(size_t i = 0; i < ciphertexts.size(); ++i) {
+                crypto_box_open_afternm(reinterpret_cast<unsigned char *>(&out[offsets[i]]), offsets[i+1] - offsets[i],
+                                        ciphertexts[i], bytes_view(current_n.data(), crypto_box_NONCEBYTES), k);
+                current_n.increment();
+            }
+        }
+    };
+
+    /**
+     * The tag of a secretstream message.
+     */
+    enum class secretstream_tag : unsigned char {
+        message = crypto_secretstream_xchacha20poly1305_TAG_MESSAGE, /** An ordinary message */
+        push = crypto_secretstream_xchacha20poly1305_TAG_PUSH, /** Marks the end of a set of messages, but not of the stream */
+        rekey = crypto_secretstream_xchacha20poly1305_TAG_REKEY, /** Both sides derive a new key after this message */
+        final = crypto_secretstream_xchacha20poly1305_TAG_FINAL /** The last message of the stream */
+    };
+
+    /**
+     * Encrypts a stream of messages with crypto_secretstream_xchacha20poly1305, writing into caller buffers.
+     * The receiver needs header() and the key to construct a secretstream_puller, and must pull the messages in the same order.
+     * Every message grows by crypto_secretstream_xchacha20poly1305_ABYTES bytes.
+     * The stream state is locked into memory for the lifetime of the pusher and securely erased at destroy time.
+     */
+    class secretstream_pusher {
+    private:
+        locked_bytes<sizeof(crypto_secretstream_xchacha20poly1305_state)> state;
+        unsigned char header_bytes[crypto_secretstream_xchacha20poly1305_HEADERBYTES];
+        bool finished_;
+    public:
+        /**
+         * Start a stream with the key k of crypto_secretstream_xchacha20poly1305_KEYBYTES bytes and a random header.
+         * Throws std::invalid_argument if k has the wrong length.
+         */
+        explicit secretstream_pusher(bytes_view k);
+        // A copy would encrypt with the same key and nonces as the original
+        secretstream_pusher(const secretstream_pusher&) = delete;
+        secretstream_pusher& operator=(const secretstream_pusher&) = delete;
+        /**
+         * Returns the header that the receiver needs to pull the stream.
+         */
+        bytes_view header() const { return bytes_view(header_bytes, sizeof(header_bytes)); }
+        /**
+         * Encrypts m with the tag and the optional additional data ad into c, which must have room for m.size() + crypto_secretstream_xchacha20poly1305_ABYTES bytes.
+         * Returns the number of bytes written. After tag final the stream is finished.
+         * Throws std::logic_error if the stream is finished.
+         */
+        size_t push(unsigned char *c, size_t clen, bytes_view m, secretstream_tag tag = secretstream_tag::message, bytes_view ad = bytes_view());
+        std::string push(const std::string& m, secretstream_tag tag = secretstream_tag::message, const std::string& ad = "");
+        /**
+         * Derives a new key without telling the receiver, who must call secretstream_puller::rekey() after pulling the same message.
+         */
+        void rekey();
+        /**
+         * Returns whether a message with tag final has been pushed.
+         */
+        bool finished() const { return finished_; }
+    };
+
+    /**
+     * Decrypts and verifies a stream of messages encrypted by a secretstream_pusher, writing into caller buffers.
+     * The stream state is locked into memory for the lifetime of the puller and securely erased at destroy time.
+     */
+    class secretstream_puller {
+    private:
+        locked_bytes<sizeof(crypto_secretstream_xchacha20poly1305_state)> state;
+        bool finished_;
+    public:
+        /**
+         * Start pulling the stream with the key k and the header of the pusher.
+         * Throws std::invalid_argument if k or header have the wrong length.
+         */
+        secretstream_puller(bytes_view k, bytes_view header);
+        secretstream_puller(const secretstream_puller&) = delete;
+        secretstream_puller& operator=(const secretstream_puller&) = delete;
+        /**
+         * Decrypts the next message c with the optional additional data ad into m, which must have room for c.size() - crypto_secretstream_xchacha20poly1305_ABYTES bytes,
+         * and stores its tag in tag. Returns the number of bytes written. After tag final the stream is finished.
+         * Throws crypto_error if c is too short or fails verification, in which case the state is unchanged,
+         * and std::logic_error if the stream is finished.
+         */
+        size_t pull(unsigned char *m, size_t mlen, bytes_view c, secretstream_tag& tag, bytes_view ad = bytes_view());
+        std::string pull(const std::string& c, secretstream_tag& tag, const std::string& ad = "");
+        /**
+         * Derives a new key, as secretstream_pusher::rekey() did at the same point of the stream.
+         */
+        void rekey();
+        /**
+         * Returns whether a message with tag final has been pulled.
+         */
+        bool finished() const { return finished_; }
+    };
+
+    /**
+     * Encrypts everything read from in until end of file with the key k and writes it to out,
+     * as the header followed by messages of chunk_size bytes; the last message is shorter, possibly empty, and has tag final.
+     * Memory use depends on chunk_size only. Returns the number of bytes read.
+     * Throws std::system_error if reading or writing fails.
+     */
+    unsigned long long secretstream_encrypt_fd(int in, int out, bytes_view k, size_t chunk_size = 64 * 1024);
+    /**
+     * Decrypts a stream written by secretstream_encrypt_fd with the same key and chunk_size from in to out, and returns the number of bytes written.
+     * Throws crypto_error if a message fails verification, the stream ends before the final message or continues after it.
+     * Messages are written as soon as they are verified, so everything written before an exception must be discarded.
+     */
+    unsigned long long secretstream_decrypt_fd(int in, int out, bytes_view k, size_t chunk_size = 64 * 1024);
+
+    /**
+     * The keystream of crypto_stream (XSalsa20) for a nonce and key, which can be read or applied from any byte offset.
+     * At offset 0 the output is identical to crypto_stream and crypto_stream_xor, so data encrypted by those can be
+     * decrypted piecewise, in any order, or split over several threads.
+     * The key is locked into memory for the lifetime of the object and securely erased at destroy time.
+     */
+    class stream_cipher {
+    private:
+        locked_bytes<crypto_stream_KEYBYTES> k;
+        unsigned char n[crypto_stream_NONCEBYTES];
+    public:
+        /**
+         * Throws std::invalid_argument if n or k have the wrong length.
+         */
+        stream_cipher(bytes_view n, bytes_view k);
+        /**
+         * XORs m with the keystream starting at byte offset of the stream and writes the result to c, which must have room for m.size() bytes.
+         * c may point to the same memory as m. Ranges of blocks are spread over ex if it is not nullptr.
+         * Throws std::invalid_argument if offset + m.size() does not fit in an unsigned long long.
+         */
+        void xor_at(unsigned char *c, size_t clen, bytes_view m, unsigned long long offset, executor *ex = nullptr) const;
+        /**
+         * Writes len bytes of keystream starting at byte offset of the stream to c.
+         */
+        void keystream_at(unsigned char *c, size_t len, unsigned long long offset, executor *ex = nullptr) const;
     };
 }
 
@@ -144,6 +144,7 @@ size_t Z85_decode_bound(size_t size);
 /**
  * @brief Encodes bytes from [source;sourceEnd) range into 'dest'.
  *        It can be used for implementation of your own padding scheme.
+ *        Uses AVX2 or SSE4.1 kernels when the CPU supports them, with output identical to Z85_encode_unsafe_scalar.
  *        Preconditions:
  *           - (sourceEnd - source) % 4 == 0
  *           - destination buffer must be already allocated
@@ -158,6 +159,8 @@ char* Z85_encode_unsafe(const char* source, const char* sourceEnd, char* dest);
 /**
  * @brief Decodes symbols from [source;sourceEnd) range into 'dest'.
  *        It can be used for implementation of your own padding scheme.
+ *        Uses AVX2 or SSE4.1 kernels when the CPU supports them, with output identical to Z85_decode_unsafe_scalar;
+ *        blocks that contain symbols outside the Z85 alphabet are decoded by the scalar code.
  *        Preconditions:
  *           - (sourceEnd - source) % 5 == 0
  *           - destination buffer must be already allocated
@@ -169,6 +172,16 @@ char* Z85_encode_unsafe(const char* source, const char* sourceEnd, char* dest);
  */
 char* Z85_decode_unsafe(const char* source, const char* sourceEnd, char* dest);
 
+/**
+ * @brief Portable one frame at a time implementation of Z85_encode_unsafe.
+ */
+char* Z85_encode_unsafe_scalar(const char* source, const char* sourceEnd, char* dest);
+
+/**
+ * @brief Portable one frame at a time implementation of Z85_decode_unsafe.
+ */
+char* Z85_decode_unsafe_scalar(const char* source, const char* sourceEnd, char* dest);
+
 #if defined (__cplusplus)
 }
 #endif
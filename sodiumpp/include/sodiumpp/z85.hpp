@@ -104,6 +104,96 @@ std::string decode(const std::string& source);
 
 std::string decode(const char*) Z85_DELETE_FUNCTION_DEFINITION;
 
+
+/*******************************************************************************
+ * Incremental ZeroMQ Base-85 encoding/decoding                                *
+ *******************************************************************************/
+
+/**
+ * @brief Encodes a stream of bytes that arrives in chunks of any size, writing into caller buffers.
+ *        Partial frames are carried over between calls, so memory use does not depend on the stream length.
+ *
+ *        Without a size the output is specification compliant, like encode(), and the stream length must be divisible by 4.
+ *        With a total size the output is identical to encode_with_padding() of the whole stream; the size is needed
+ *        up front because the padding count is the first symbol.
+ *        Misuse (more or fewer bytes than announced, a partial frame without padding) throws std::invalid_argument.
+ */
+class encoder
+{
+public:
+   /** The most symbols finish() writes */
+   static const size_t finishBound = 6;
+
+   encoder();
+   explicit encoder(unsigned long long totalSize);
+
+   /**
+    * @brief Returns the most symbols update() writes for 'inputSize' bytes.
+    */
+   static size_t updateBound(size_t inputSize) { return (inputSize + 3) / 4 * 5 + 1; }
+
+   /**
+    * @brief Encodes 'inputSize' bytes from 'source' into 'dest' and returns the number of symbols written.
+    */
+   size_t update(const char* source, size_t inputSize, char* dest);
+
+   /**
+    * @brief Writes the last (padded) frame into 'dest' and returns the number of symbols written.
+    */
+   size_t finish(char* dest);
+
+private:
+   bool               padded;
+   bool               started;
+   unsigned long long remaining;
+   char               pending[4];
+   size_t             pendingSize;
+
+   size_t start(char* dest);
+};
+
+/**
+ * @brief Decodes a stream of symbols that arrives in chunks of any size, writing into caller buffers.
+ *
+ *        Without padding the input must be specification compliant, like for decode(). With padding it must be
+ *        the output of encode_with_padding() or a padded encoder, and the last frame is held back until finish(),
+ *        which writes only the bytes it really contains.
+ *        A wrong padding symbol or a truncated stream throws std::invalid_argument.
+ */
+class decoder
+{
+public:
+   /** The most bytes finish() writes */
+   static const size_t finishBound = 4;
+
+   explicit decoder(bool padded = true);
+
+   /**
+    * @brief Returns the most bytes update() writes for 'inputSize' symbols.
+    */
+   static size_t updateBound(size_t inputSize) { return (inputSize + 4) / 5 * 4; }
+
+   /**
+    * @brief Decodes 'inputSize' symbols from 'source' into 'dest' and returns the number of bytes written.
+    */
+   size_t update(const char* source, size_t inputSize, char* dest);
+
+   /**
+    * @brief Writes the bytes of the last frame into 'dest' and returns their number.
+    */
+   size_t finish(char* dest);
+
+private:
+   bool   padded;
+   size_t tailBytes;
+   bool   holding;
+   char   held[4];
+   char   pending[5];
+   size_t pendingSize;
+
+   char* decodeFrames(const char* source, size_t size, char* dest);
+};
+
 } // namespace z85
 
 #undef Z85_DELETE_FUNCTION_DEFINITION
@@ -0,0 +1,163 @@
+// Copyright (c) 2014, Ruben De Visscher
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <sodiumpp/sodiumpp.h>
+#include <cstdint>
+#include <thread>
+
+// The queue is the bounded multi-producer, multi-consumer queue of Dmitry Vyukov:
+// every cell carries a sequence number that tells producers and consumers whose turn it is,
+// so a push or pop takes a single compare-and-swap on its position when there is no contention.
+template <sodiumpp::key_purpose P>
+struct sodiumpp::keypair_factory<P>::cell {
+    std::atomic<size_t> sequence;
+    secret_key<P> *sk;
+};
+
+template <sodiumpp::key_purpose P>
+sodiumpp::keypair_factory<P>::keypair_factory(size_t capacity, executor *ex, size_t batch)
+    : batch(batch), ex(ex), push_position(0), pop_position(0), refilling(false), stopping(false), miss_count(0) {
+    if(capacity == 0 or batch == 0) {
+        throw std::invalid_argument("capacity and batch must be positive");
+    }
+    size_t rounded = 2;
+    while(rounded < capacity) rounded *= 2;
+    mask = rounded - 1;
+    cells.reset(new cell[rounded]);
+    for(size_t i = 0; i < rounded; ++i) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+        cells[i].sk = nullptr;
+    }
+    if(ex != nullptr) {
+        refilling.store(true);
+        ex->execute([this]() {
+            refill();
+            refilling.store(false, std::memory_order_release);
+        });
+    }
+}
+
+template <sodiumpp::key_purpose P>
+sodiumpp::keypair_factory<P>::~keypair_factory() {
+    stopping.store(true);
+    while(refilling.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    while(secret_key<P> *sk = try_pop()) {
+        delete sk;
+    }
+}
+
+template <sodiumpp::key_purpose P>
+bool sodiumpp::keypair_factory<P>::push(secret_key<P> *sk) {
+    size_t position = push_position.load(std::memory_order_relaxed);
+    for(;;) {
+        cell& c = cells[position & mask];
+        size_t sequence = c.sequence.load(std::memory_order_acquire);
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+        if(difference == 0) {
+            if(push_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                c.sk = sk;
+                c.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        } else if(difference < 0) {
+            // The cell still holds the keypair from one lap ago: the queue is full
+            return false;
+        } else {
+            position = push_position.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <sodiumpp::key_purpose P>
+sodiumpp::secret_key<P> *sodiumpp::keypair_factory<P>::try_pop() {
+    size_t position = pop_position.load(std::memory_order_relaxed);
+    for(;;) {
+        cell& c = cells[position & mask];
+        size_t sequence = c.sequence.load(std::memory_order_acquire);
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+        if(difference == 0) {
+            if(pop_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                secret_key<P> *sk = c.sk;
+                c.sequence.store(position + mask + 1, std::memory_order_release);
+                return sk;
+            }
+        } else if(difference < 0) {
+            // The cell has not been filled since the previous lap: the queue is empty
+            return nullptr;
+        } else {
+            position = pop_position.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <sodiumpp::key_purpose P>
+void sodiumpp::keypair_factory<P>::refill() {
+    size_t missing = capacity() - std::min(size(), capacity());
+    parallel_for(ex, missing, batch, [this](size_t begin, size_t end) {
+        for(size_t i = begin; i < end and not stopping.load(std::memory_order_relaxed); ++i) {
+            std::unique_ptr<secret_key<P>> sk;
+            try {
+                sk.reset(new secret_key<P>());
+            } catch(const std::bad_alloc&) {
+                // Out of locked memory: pop() generates keypairs itself when the queue runs dry
+                return;
+            }
+            if(not push(sk.get())) return;
+            sk.release();
+        }
+    });
+}
+
+template <sodiumpp::key_purpose P>
+std::unique_ptr<sodiumpp::secret_key<P>> sodiumpp::keypair_factory<P>::pop() {
+    std::unique_ptr<secret_key<P>> sk(try_pop());
+    if(not sk) {
+        miss_count.fetch_add(1, std::memory_order_relaxed);
+        sk.reset(new secret_key<P>());
+    }
+    if(ex != nullptr and size() <= capacity() / 2 and not refilling.exchange(true)) {
+        ex->execute([this]() {
+            refill();
+            refilling.store(false, std::memory_order_release);
+        });
+    }
+    return sk;
+}
+
+template <sodiumpp::key_purpose P>
+void sodiumpp::keypair_factory<P>::fill() {
+    refill();
+}
+
+template <sodiumpp::key_purpose P>
+size_t sodiumpp::keypair_factory<P>::size() const {
+    size_t popped = pop_position.load(std::memory_order_acquire);
+    size_t pushed = push_position.load(std::memory_order_acquire);
+    // A pop may have been counted after a push that was not: report an empty queue rather than wrap around
+    return pushed > popped ? pushed - popped : 0;
+}
+
+template class sodiumpp::keypair_factory<sodiumpp::key_purpose::box>;
+template class sodiumpp::keypair_factory<sodiumpp::key_purpose::sign>;
@@ -0,0 +1,137 @@
+// Copyright (c) 2014, Ruben De Visscher
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <sodiumpp/parallel.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+sodiumpp::thread_pool::thread_pool(size_t threads) : stopping(false) {
+    if(threads == 0) threads = 1;
+    workers.reserve(threads);
+    for(size_t i = 0; i < threads; ++i) {
+        workers.push_back(std::thread(&thread_pool::work, this));
+    }
+}
+
+sodiumpp::thread_pool::~thread_pool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    available.notify_all();
+    for(std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void sodiumpp::thread_pool::execute(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    available.notify_one();
+}
+
+void sodiumpp::thread_pool::work() {
+    for(;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            available.wait(lock, [this](){ return stopping || !tasks.empty(); });
+            if(tasks.empty()) return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+namespace {
+    /**
+     * State shared between the caller of parallel_for and the helper tasks it submitted.
+     * Helpers that only start after all ranges have been claimed find nothing left to do,
+     * so the caller only has to wait for ranges that are actually being worked on.
+     */
+    struct parallel_for_state {
+        std::atomic<size_t> next_range;
+        size_t ranges;
+        size_t count;
+        size_t grain;
+        const std::function<void(size_t, size_t)>* body;
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t completed;
+        std::exception_ptr error;
+
+        void run() {
+            for(;;) {
+                size_t range = next_range.fetch_add(1);
+                if(range >= ranges) return;
+                size_t begin = range * grain;
+                try {
+                    (*body)(begin, std::min(count, begin + grain));
+                } catch(...) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if(!error) error = std::current_exception();
+                    // Stop handing out ranges, and account for the ones nobody will claim
+                    size_t claimed = next_range.exchange(ranges);
+                    if(claimed < ranges) completed += ranges - claimed;
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                if(++completed == ranges) done.notify_all();
+            }
+        }
+    };
+}
+
+void sodiumpp::parallel_for(executor *ex, size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+    if(count == 0) return;
+    if(grain == 0) grain = 1;
+    size_t ranges = (count + grain - 1) / grain;
+    if(ex == nullptr || ranges == 1) {
+        for(size_t begin = 0; begin < count; begin += grain) {
+            body(begin, std::min(count, begin + grain));
+        }
+        return;
+    }
+
+    std::shared_ptr<parallel_for_state> state = std::make_shared<parallel_for_state>();
+    state->next_range = 0;
+    state->ranges = ranges;
+    state->count = count;
+    state->grain = grain;
+    state->body = &body;
+    state->completed = 0;
+
+    size_t helpers = std::min(ranges - 1, std::max<size_t>(ex->concurrency(), 1));
+    for(size_t i = 0; i < helpers; ++i) {
+        ex->execute([state](){ state->run(); });
+    }
+    state->run();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [&state](){ return state->completed == state->ranges; });
+    if(state->error) std::rethrow_exception(state->error);
+}
@@ -0,0 +1,153 @@
+// Copyright (c) 2014, Ruben De Visscher
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <sodiumpp/sodiumpp.h>
+#include <cerrno>
+#include <system_error>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+    typedef crypto_secretstream_xchacha20poly1305_state state_type;
+
+    const size_t abytes = crypto_secretstream_xchacha20poly1305_ABYTES;
+
+    /** Reads until len bytes have been read or end of file, and returns the number of bytes read */
+    size_t read_full(int fd, unsigned char *buf, size_t len) {
+        size_t done = 0;
+        while(done < len) {
+            ssize_t n = ::read(fd, buf + done, len - done);
+            if(n < 0 && errno == EINTR) continue;
+            if(n < 0) throw std::system_error(errno, std::generic_category(), "read");
+            if(n == 0) break;
+            done += n;
+        }
+        return done;
+    }
+
+    void write_full(int fd, const unsigned char *buf, size_t len) {
+        while(len > 0) {
+            ssize_t n = ::write(fd, buf, len);
+            if(n < 0 && errno == EINTR) continue;
+            if(n < 0) throw std::system_error(errno, std::generic_category(), "write");
+            buf += n;
+            len -= n;
+        }
+    }
+}
+
+sodiumpp::secretstream_pusher::secretstream_pusher(bytes_view k) : finished_(false) {
+    if(k.size() != crypto_secretstream_xchacha20poly1305_KEYBYTES) throw std::invalid_argument("incorrect key length");
+    crypto_secretstream_xchacha20poly1305_init_push(reinterpret_cast<state_type *>(state.data()), header_bytes, k.data());
+}
+
+size_t sodiumpp::secretstream_pusher::push(unsigned char *c, size_t clen, bytes_view m, secretstream_tag tag, bytes_view ad) {
+    if(finished_) throw std::logic_error("stream is finished");
+    if(clen < m.size() + abytes) throw std::invalid_argument("output buffer too small");
+    unsigned long long written;
+    crypto_secretstream_xchacha20poly1305_push(reinterpret_cast<state_type *>(state.data()), c, &written, m.data(), m.size(),
+                                               ad.data(), ad.size(), static_cast<unsigned char>(tag));
+    finished_ = tag == secretstream_tag::final;
+    return written;
+}
+
+std::string sodiumpp::secretstream_pusher::push(const std::string& m, secretstream_tag tag, const std::string& ad) {
+    std::string c(m.size() + abytes, 0);
+    push(reinterpret_cast<unsigned char *>(&c[0]), c.size(), m, tag, ad);
+    return c;
+}
+
+void sodiumpp::secretstream_pusher::rekey() {
+    crypto_secretstream_xchacha20poly1305_rekey(reinterpret_cast<state_type *>(state.data()));
+}
+
+sodiumpp::secretstream_puller::secretstream_puller(bytes_view k, bytes_view header) : finished_(false) {
+    if(k.size() != crypto_secretstream_xchacha20poly1305_KEYBYTES) throw std::invalid_argument("incorrect key length");
+    if(header.size() != crypto_secretstream_xchacha20poly1305_HEADERBYTES) throw std::invalid_argument("incorrect header length");
+    crypto_secretstream_xchacha20poly1305_init_pull(reinterpret_cast<state_type *>(state.data()), header.data(), k.data());
+}
+
+size_t sodiumpp::secretstream_puller::pull(unsigned char *m, size_t mlen, bytes_view c, secretstream_tag& tag, bytes_view ad) {
+    if(finished_) throw std::logic_error("stream is finished");
+    if(c.size() < abytes) throw crypto_error("ciphertext too short");
+    if(mlen < c.size() - abytes) throw std::invalid_argument("output buffer too small");
+    unsigned long long written;
+    unsigned char t;
+    if(crypto_secretstream_xchacha20poly1305_pull(reinterpret_cast<state_type *>(state.data()), m, &written, &t,
+                                                  c.data(), c.size(), ad.data(), ad.size()) != 0) {
+        throw crypto_error("ciphertext fails verification");
+    }
+    tag = static_cast<secretstream_tag>(t);
+    finished_ = tag == secretstream_tag::final;
+    return written;
+}
+
+std::string sodiumpp::secretstream_puller::pull(const std::string& c, secretstream_tag& tag, const std::string& ad) {
+    std::string m(c.size() < abytes ? 0 : c.size() - abytes, 0);
+    pull(reinterpret_cast<unsigned char *>(&m[0]), m.size(), c, tag, ad);
+    return m;
+}
+
+void sodiumpp::secretstream_puller::rekey() {
+    crypto_secretstream_xchacha20poly1305_rekey(reinterpret_cast<state_type *>(state.data()));
+}
+
+unsigned long long sodiumpp::secretstream_encrypt_fd(int in, int out, bytes_view k, size_t chunk_size) {
+    if(chunk_size == 0) throw std::invalid_argument("chunk size must not be 0");
+    secretstream_pusher pusher(k);
+    write_full(out, pusher.header().data(), pusher.header().size());
+    std::vector<unsigned char> m(chunk_size), c(chunk_size + abytes);
+    unsigned long long total = 0;
+    while(!pusher.finished()) {
+        size_t n = read_full(in, m.data(), m.size());
+        total += n;
+        // A short read means end of file, so the last message is shorter than chunk_size, if need be empty
+        secretstream_tag tag = n < chunk_size ? secretstream_tag::final : secretstream_tag::message;
+        size_t clen = pusher.push(c.data(), c.size(), bytes_view(m.data(), n), tag);
+        write_full(out, c.data(), clen);
+    }
+    sodium_memzero(m.data(), m.size());
+    return total;
+}
+
+unsigned long long sodiumpp::secretstream_decrypt_fd(int in, int out, bytes_view k, size_t chunk_size) {
+    if(chunk_size == 0) throw std::invalid_argument("chunk size must not be 0");
+    unsigned char header[crypto_secretstream_xchacha20poly1305_HEADERBYTES];
+    if(read_full(in, header, sizeof(header)) != sizeof(header)) throw crypto_error("stream too short");
+    secretstream_puller puller(k, bytes_view(header, sizeof(header)));
+    std::vector<unsigned char> c(chunk_size + abytes), m(chunk_size);
+    unsigned long long total = 0;
+    while(!puller.finished()) {
+        size_t n = read_full(in, c.data(), c.size());
+        if(n == 0) throw crypto_error("stream ends before the final message");
+        secretstream_tag tag;
+        size_t mlen = puller.pull(m.data(), m.size(), bytes_view(c.data(), n), tag);
+        if(tag != secretstream_tag::final && n < c.size()) throw crypto_error("stream ends before the final message");
+        write_full(out, m.data(), mlen);
+        total += mlen;
+    }
+    unsigned char extra;
+    if(read_full(in, &extra, 1) != 0) throw crypto_error("data after the final message");
+    sodium_memzero(m.data(), m.size());
+    return total;
+}
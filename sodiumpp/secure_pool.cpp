@@ -0,0 +1,69 @@
+// Copyright (c) 2014, Ruben De Visscher
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <sodiumpp/secure_pool.h>
+#include <sodiumpp/sodiumpp.h>
+#include <new>
+
+sodiumpp::secure_pool& sodiumpp::secure_pool::instance() {
+    // Deliberately leaked: secrets with static storage duration may outlive any static pool
+    static secure_pool *pool = new secure_pool();
+    return *pool;
+}
+
+unsigned char *sodiumpp::secure_pool::allocate() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(free_slots.empty()) {
+        init();
+        // Reserve first so that deallocate() never has to grow free_slots
+        free_slots.reserve((chunks.size() + 1) * slots_per_chunk);
+        chunks.reserve(chunks.size() + 1);
+        unsigned char *chunk = static_cast<unsigned char *>(sodium_malloc(slot_size * slots_per_chunk));
+        if(chunk == nullptr) throw std::bad_alloc();
+        sodium_memzero(chunk, slot_size * slots_per_chunk);
+        chunks.push_back(chunk);
+        // Hand out slots in address order
+        for(size_t i = slots_per_chunk; i > 0; --i) {
+            free_slots.push_back(chunk + (i - 1) * slot_size);
+        }
+    }
+    unsigned char *slot = free_slots.back();
+    free_slots.pop_back();
+    return slot;
+}
+
+void sodiumpp::secure_pool::deallocate(unsigned char *slot) {
+    sodium_memzero(slot, slot_size);
+    std::lock_guard<std::mutex> lock(mutex);
+    free_slots.push_back(slot);
+}
+
+size_t sodiumpp::secure_pool::capacity() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return chunks.size() * slots_per_chunk;
+}
+
+size_t sodiumpp::secure_pool::in_use() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return chunks.size() * slots_per_chunk - free_slots.size();
+}
@@ -0,0 +1,130 @@
+// Copyright (c) 2014, Ruben De Visscher
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <sodiumpp/sodiumpp.h>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+    const size_t tag_bytes = 16;
+    const size_t max_shards = 16;
+    const size_t min_shard_capacity = 8;
+
+    struct tag_type {
+        unsigned char bytes[tag_bytes];
+        bool operator==(const tag_type& other) const { return std::memcmp(bytes, other.bytes, tag_bytes) == 0; }
+    };
+
+    struct tag_hash {
+        size_t operator()(const tag_type& tag) const {
+            // The tag is a keyed hash already, so any of its bytes are uniformly distributed
+            size_t h;
+            std::memcpy(&h, tag.bytes + sizeof(uint64_t), sizeof(h));
+            return h;
+        }
+    };
+}
+
+struct sodiumpp::shared_key_cache::shard {
+    struct entry {
+        tag_type tag;
+        bool used = false;
+        bool referenced = false;
+        locked_bytes<crypto_box_BEFORENMBYTES> k;
+    };
+    std::mutex mutex;
+    std::vector<entry> entries;
+    std::unordered_map<tag_type, size_t, tag_hash> index;
+    size_t hand = 0;
+
+    explicit shard(size_t capacity) : entries(capacity) {
+        index.reserve(capacity);
+    }
+
+    bool find(const tag_type& tag, unsigned char *k) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(tag);
+        if(it == index.end()) return false;
+        entry& e = entries[it->second];
+        e.referenced = true;
+        std::copy(e.k.data(), e.k.data() + e.k.size(), k);
+        return true;
+    }
+
+    void insert(const tag_type& tag, const unsigned char *k) {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Another thread may have computed the same parameter in the meantime
+        if(index.count(tag)) return;
+        while(entries[hand].used and entries[hand].referenced) {
+            entries[hand].referenced = false;
+            hand = (hand + 1) % entries.size();
+        }
+        entry& victim = entries[hand];
+        hand = (hand + 1) % entries.size();
+        if(victim.used) {
+            index.erase(victim.tag);
+        }
+        victim.tag = tag;
+        victim.used = true;
+        victim.referenced = false;
+        std::copy(k, k + victim.k.size(), victim.k.data());
+        index.emplace(tag, &victim - &entries[0]);
+    }
+};
+
+sodiumpp::shared_key_cache::shared_key_cache(size_t capacity) : hit_count(0), miss_count(0) {
+    if(capacity == 0) throw std::invalid_argument("capacity must be greater than 0");
+    size_t count = std::max<size_t>(1, std::min(max_shards, capacity / min_shard_capacity));
+    size_t per_shard = (capacity + count - 1) / count;
+    shards.reserve(count);
+    for(size_t i = 0; i < count; ++i) {
+        shards.emplace_back(new shard(per_shard));
+    }
+    randombytes_buf(tag_key.data(), tag_key.size());
+}
+
+sodiumpp::shared_key_cache::~shared_key_cache() {}
+
+void sodiumpp::shared_key_cache::beforenm(unsigned char *k, const box_public_key& pk, const box_secret_key& sk) {
+    tag_type tag;
+    crypto_generichash_state state;
+    crypto_generichash_init(&state, tag_key.data(), tag_key.size(), tag_bytes);
+    crypto_generichash_update(&state, pk.data(), pk.size());
+    crypto_generichash_update(&state, sk.data(), sk.size());
+    crypto_generichash_final(&state, tag.bytes, tag_bytes);
+    sodium_memzero(&state, sizeof(state));
+
+    shard& s = *shards[tag.bytes[0] % shards.size()];
+    if(s.find(tag, k)) {
+        hit_count.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    miss_count.fetch_add(1, std::memory_order_relaxed);
+    crypto_box_beforenm(k, crypto_box_BEFORENMBYTES, bytes_view(pk.data(), pk.size()), bytes_view(sk.data(), sk.size()));
+    s.insert(tag, k);
+}
+
+size_t sodiumpp::shared_key_cache::capacity() const {
+    return shards.size() * shards[0]->entries.size();
+}
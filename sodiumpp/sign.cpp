@@ -0,0 +1,104 @@
+// Copyright (c) 2014, Ruben De Visscher
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <sodiumpp/sodiumpp.h>
+#include <bitset>
+
+namespace {
+    bool verify(const sodiumpp::signature_check& check) {
+        return check.sig.size() == crypto_sign_BYTES && check.pk.size() == crypto_sign_PUBLICKEYBYTES &&
+               ::crypto_sign_verify_detached(check.sig.data(), check.m.data(), check.m.size(), check.pk.data()) == 0;
+    }
+}
+
+size_t sodiumpp::verification_results::passed() const {
+    size_t n = 0;
+    for(uint64_t w : words) n += std::bitset<64>(w).count();
+    return n;
+}
+
+sodiumpp::verification_results sodiumpp::crypto_sign_verify_batch(const std::vector<signature_check>& checks, executor *ex) {
+    verification_results results(checks.size());
+    // Ranges of whole bitmap words, so no two ranges write to the same word
+    parallel_for(ex, checks.size(), 64, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; ++i) {
+            if(verify(checks[i])) results.set(i);
+        }
+    });
+    return results;
+}
+
+sodiumpp::signer::signer(const sign_secret_key& sk) : sk(sk) {
+    crypto_sign_init(&state);
+}
+
+size_t sodiumpp::signer::sign(unsigned char *sig, size_t siglen, bytes_view m) const {
+    return crypto_sign_detached(sig, siglen, m, bytes_view(sk.data(), sk.size()));
+}
+
+std::string sodiumpp::signer::sign(bytes_view m) const {
+    std::string sig(crypto_sign_BYTES, 0);
+    sign(reinterpret_cast<unsigned char *>(&sig[0]), sig.size(), m);
+    return sig;
+}
+
+sodiumpp::signer& sodiumpp::signer::update(bytes_view m) {
+    crypto_sign_update(&state, m.data(), m.size());
+    return *this;
+}
+
+size_t sodiumpp::signer::final(unsigned char *sig, size_t siglen) {
+    if(siglen < crypto_sign_BYTES) throw std::invalid_argument("output buffer too small");
+    crypto_sign_final_create(&state, sig, nullptr, sk.data());
+    crypto_sign_init(&state);
+    return crypto_sign_BYTES;
+}
+
+std::string sodiumpp::signer::final() {
+    std::string sig(crypto_sign_BYTES, 0);
+    final(reinterpret_cast<unsigned char *>(&sig[0]), sig.size());
+    return sig;
+}
+
+sodiumpp::verifier::verifier(const sign_public_key& pk) : pk(pk) {
+    crypto_sign_init(&state);
+}
+
+bool sodiumpp::verifier::check(bytes_view sig, bytes_view m) const {
+    return sig.size() == crypto_sign_BYTES && ::crypto_sign_verify_detached(sig.data(), m.data(), m.size(), pk.data()) == 0;
+}
+
+void sodiumpp::verifier::verify(bytes_view sig, bytes_view m) const {
+    if(!check(sig, m)) throw crypto_error("signature fails verification");
+}
+
+sodiumpp::verifier& sodiumpp::verifier::update(bytes_view m) {
+    crypto_sign_update(&state, m.data(), m.size());
+    return *this;
+}
+
+void sodiumpp::verifier::final(bytes_view sig) {
+    bool valid = sig.size() == crypto_sign_BYTES && crypto_sign_final_verify(&state, const_cast<unsigned char *>(sig.data()), pk.data()) == 0;
+    crypto_sign_init(&state);
+    if(!valid) throw crypto_error("signature fails verification");
+}
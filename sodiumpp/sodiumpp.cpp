@@ -24,53 +24,66 @@
 #include <sodiumpp/sodiumpp.h>
 #include <sodiumpp/z85.hpp>
 #include <cassert>
+#include <algorithm>
 
 std::string sodiumpp::crypto_auth(const std::string &m,const std::string &k)
+{
+    std::string a(crypto_auth_BYTES, 0);
+    crypto_auth((unsigned char *)&a[0],a.size(),m,k);
+    return a;
+}
+
+size_t sodiumpp::crypto_auth(unsigned char *a,size_t alen,bytes_view m,bytes_view k)
 {
     if (k.size() != crypto_auth_KEYBYTES) throw std::invalid_argument("incorrect key length");
-    unsigned char a[crypto_auth_BYTES];
-    ::crypto_auth(a,(const unsigned char *) m.c_str(),m.size(),(const unsigned char *) k.c_str());
-    return std::string((char *) a,crypto_auth_BYTES);
+    if (alen < crypto_auth_BYTES) throw std::invalid_argument("output buffer too small");
+    ::crypto_auth(a,m.data(),m.size(),k.data());
+    return crypto_auth_BYTES;
 }
 
 void sodiumpp::crypto_auth_verify(const std::string &a,const std::string &m,const std::string &k)
+{
+    crypto_auth_verify(bytes_view(a),bytes_view(m),bytes_view(k));
+}
+
+void sodiumpp::crypto_auth_verify(bytes_view a,bytes_view m,bytes_view k)
 {
     if (k.size() != crypto_auth_KEYBYTES) throw std::invalid_argument("incorrect key length");
     if (a.size() != crypto_auth_BYTES) throw std::invalid_argument("incorrect authenticator length");
-    if (::crypto_auth_verify(
-                           (const unsigned char *) a.c_str(),
-                           (const unsigned char *) m.c_str(),m.size(),
-                           (const unsigned char *) k.c_str()) == 0) return;
+    if (::crypto_auth_verify(a.data(),m.data(),m.size(),k.data()) == 0) return;
     throw sodiumpp::crypto_error("invalid authenticator");
 }
 
 std::string sodiumpp::crypto_box(const std::string &m,const std::string &n,const std::string &pk,const std::string &sk)
+{
+    std::string c(m.size() + crypto_box_MACBYTES, 0);
+    crypto_box((unsigned char *)&c[0],c.size(),m,n,pk,sk);
+    return c;
+}
+
+size_t sodiumpp::crypto_box(unsigned char *c,size_t clen,bytes_view m,bytes_view n,bytes_view pk,bytes_view sk)
 {
     if (pk.size() != crypto_box_PUBLICKEYBYTES) throw std::invalid_argument("incorrect public-key length");
     if (sk.size() != crypto_box_SECRETKEYBYTES) throw std::invalid_argument("incorrect secret-key length");
     if (n.size() != crypto_box_NONCEBYTES) throw std::invalid_argument("incorrect nonce length");
-    size_t mlen = m.size() + crypto_box_ZEROBYTES;
-    unsigned char mpad[mlen];
-    for (size_t i = 0;i < crypto_box_ZEROBYTES;++i) mpad[i] = 0;
-    for (size_t i = crypto_box_ZEROBYTES;i < mlen;++i) mpad[i] = m[i - crypto_box_ZEROBYTES];
-    unsigned char cpad[mlen];
-    ::crypto_box(cpad,mpad,mlen,
-               (const unsigned char *) n.c_str(),
-               (const unsigned char *) pk.c_str(),
-               (const unsigned char *) sk.c_str()
-               );
-    return std::string(
-                  (char *) cpad + crypto_box_BOXZEROBYTES,
-                  mlen - crypto_box_BOXZEROBYTES
-                  );
+    if (clen < m.size() + crypto_box_MACBYTES) throw std::invalid_argument("output buffer too small");
+    ::crypto_box_easy(c,m.data(),m.size(),n.data(),pk.data(),sk.data());
+    return m.size() + crypto_box_MACBYTES;
 }
 
 std::string sodiumpp::crypto_box_keypair(std::string& sk_string)
 {
-    unsigned char pk[crypto_box_PUBLICKEYBYTES];
+    std::string pk(crypto_box_PUBLICKEYBYTES, 0);
     sk_string.resize(crypto_box_SECRETKEYBYTES, 0);
-    ::crypto_box_keypair(pk,(unsigned char *)&sk_string[0]);
-    return std::string((char *) pk,sizeof pk);
+    crypto_box_keypair((unsigned char *)&pk[0],pk.size(),(unsigned char *)&sk_string[0],sk_string.size());
+    return pk;
+}
+
+void sodiumpp::crypto_box_keypair(unsigned char *pk,size_t pklen,unsigned char *sk,size_t sklen)
+{
+    if (pklen != crypto_box_PUBLICKEYBYTES) throw std::invalid_argument("incorrect public-key length");
+    if (sklen != crypto_box_SECRETKEYBYTES) throw std::invalid_argument("incorrect secret-key length");
+    ::crypto_box_keypair(pk,sk);
 }
 
 const std::string sodiumpp::crypto_box_beforenm(const std::string &pk, const std::string &sk) {
@@ -78,247 +91,316 @@ const std::string sodiumpp::crypto_box_beforenm(const std::string &pk, const std
     if (sk.size() != crypto_box_SECRETKEYBYTES) throw std::invalid_argument("incorrect secret-key length");
     const std::string k(crypto_box_BEFORENMBYTES, 0);
     mlock(k);
-    ::crypto_box_beforenm((unsigned char *)&k[0], (const unsigned char *)&pk[0], (const unsigned char *)&sk[0]);
+    crypto_box_beforenm((unsigned char *)&k[0], k.size(), pk, sk);
     return k;
 }
 
+size_t sodiumpp::crypto_box_beforenm(unsigned char *k,size_t klen,bytes_view pk,bytes_view sk) {
+    if (pk.size() != crypto_box_PUBLICKEYBYTES) throw std::invalid_argument("incorrect public-key length");
+    if (sk.size() != crypto_box_SECRETKEYBYTES) throw std::invalid_argument("incorrect secret-key length");
+    if (klen < crypto_box_BEFORENMBYTES) throw std::invalid_argument("output buffer too small");
+    ::crypto_box_beforenm(k, pk.data(), sk.data());
+    return crypto_box_BEFORENMBYTES;
+}
+
 std::string sodiumpp::crypto_box_afternm(const std::string &m,const std::string &n,const std::string &k) {
+    std::string c(m.size() + crypto_box_MACBYTES, 0);
+    crypto_box_afternm((unsigned char *)&c[0],c.size(),m,n,k);
+    return c;
+}
+
+size_t sodiumpp::crypto_box_afternm(unsigned char *c,size_t clen,bytes_view m,bytes_view n,bytes_view k) {
     if (k.size() != crypto_box_BEFORENMBYTES) throw std::invalid_argument("incorrect nm-key length");
     if (n.size() != crypto_box_NONCEBYTES) throw std::invalid_argument("incorrect nonce length");
-    size_t mlen = m.size() + crypto_box_ZEROBYTES;
-    unsigned char mpad[mlen];
-    for (size_t i = 0;i < crypto_box_ZEROBYTES;++i) mpad[i] = 0;
-    for (size_t i = crypto_box_ZEROBYTES;i < mlen;++i) mpad[i] = m[i - crypto_box_ZEROBYTES];
-    unsigned char cpad[mlen];
-    ::crypto_box_afternm(cpad,mpad,mlen,
-                 (const unsigned char *) n.c_str(),
-                 (const unsigned char *) k.c_str()
-                 );
-    return std::string(
-                  (char *) cpad + crypto_box_BOXZEROBYTES,
-                  mlen - crypto_box_BOXZEROBYTES
-                  );
+    if (clen < m.size() + crypto_box_MACBYTES) throw std::invalid_argument("output buffer too small");
+    ::crypto_box_easy_afternm(c,m.data(),m.size(),n.data(),k.data());
+    return m.size() + crypto_box_MACBYTES;
 }
 
 std::string sodiumpp::crypto_box_open_afternm(const std::string &c,const std::string &n,const std::string &k)
+{
+    std::string m(c.size() < crypto_box_MACBYTES ? 0 : c.size() - crypto_box_MACBYTES, 0);
+    crypto_box_open_afternm((unsigned char *)&m[0],m.size(),c,n,k);
+    return m;
+}
+
+size_t sodiumpp::crypto_box_open_afternm(unsigned char *m,size_t mlen,bytes_view c,bytes_view n,bytes_view k)
 {
     if (k.size() != crypto_box_BEFORENMBYTES) throw std::invalid_argument("incorrect nm-key length");
     if (n.size() != crypto_box_NONCEBYTES) throw std::invalid_argument("incorrect nonce length");
-    size_t clen = c.size() + crypto_box_BOXZEROBYTES;
-    unsigned char cpad[clen];
-    for (size_t i = 0;i < crypto_box_BOXZEROBYTES;++i) cpad[i] = 0;
-    for (size_t i = crypto_box_BOXZEROBYTES;i < clen;++i) cpad[i] = c[i - crypto_box_BOXZEROBYTES];
-    unsigned char mpad[clen];
-    if (::crypto_box_open_afternm(mpad,cpad,clen,
-                                  (const unsigned char *) n.c_str(),
-                                  (const unsigned char *) k.c_str()
-                                  ) != 0)
+    if (c.size() < crypto_box_MACBYTES)
+        throw sodiumpp::crypto_error("ciphertext too short");
+    if (mlen < c.size() - crypto_box_MACBYTES) throw std::invalid_argument("output buffer too small");
+    if (::crypto_box_open_easy_afternm(m,c.data(),c.size(),n.data(),k.data()) != 0)
         throw sodiumpp::crypto_error("ciphertext fails verification");
-    if (clen < crypto_box_ZEROBYTES)
-        throw sodiumpp::crypto_error("ciphertext too short"); // should have been caught by _open
-    return std::string(
-                  (char *) mpad + crypto_box_ZEROBYTES,
-                  clen - crypto_box_ZEROBYTES
-                  );
+    return c.size() - crypto_box_MACBYTES;
+}
+
+size_t sodiumpp::crypto_box_detached_afternm(unsigned char *c,unsigned char *mac,bytes_view m,bytes_view n,bytes_view k)
+{
+    if (k.size() != crypto_box_BEFORENMBYTES) throw std::invalid_argument("incorrect nm-key length");
+    if (n.size() != crypto_box_NONCEBYTES) throw std::invalid_argument("incorrect nonce length");
+    ::crypto_box_detached_afternm(c,mac,m.data(),m.size(),n.data(),k.data());
+    return m.size();
+}
+
+size_t sodiumpp::crypto_box_open_detached_afternm(unsigned char *m,bytes_view c,bytes_view mac,bytes_view n,bytes_view k)
+{
+    if (k.size() != crypto_box_BEFORENMBYTES) throw std::invalid_argument("incorrect nm-key length");
+    if (n.size() != crypto_box_NONCEBYTES) throw std::invalid_argument("incorrect nonce length");
+    if (mac.size() != crypto_box_MACBYTES) throw std::invalid_argument("incorrect mac length");
+    if (::crypto_box_open_detached_afternm(m,c.data(),mac.data(),c.size(),n.data(),k.data()) != 0)
+        throw sodiumpp::crypto_error("ciphertext fails verification");
+    return c.size();
 }
 
 std::string sodiumpp::crypto_box_open(const std::string &c,const std::string &n,const std::string &pk,const std::string &sk)
+{
+    std::string m(c.size() < crypto_box_MACBYTES ? 0 : c.size() - crypto_box_MACBYTES, 0);
+    crypto_box_open((unsigned char *)&m[0],m.size(),c,n,pk,sk);
+    return m;
+}
+
+size_t sodiumpp::crypto_box_open(unsigned char *m,size_t mlen,bytes_view c,bytes_view n,bytes_view pk,bytes_view sk)
 {
     if (pk.size() != crypto_box_PUBLICKEYBYTES) throw std::invalid_argument("incorrect public-key length");
     if (sk.size() != crypto_box_SECRETKEYBYTES) throw std::invalid_argument("incorrect secret-key length");
     if (n.size() != crypto_box_NONCEBYTES) throw std::invalid_argument("incorrect nonce length");
-    size_t clen = c.size() + crypto_box_BOXZEROBYTES;
-    unsigned char cpad[clen];
-    for (size_t i = 0;i < crypto_box_BOXZEROBYTES;++i) cpad[i] = 0;
-    for (size_t i = crypto_box_BOXZEROBYTES;i < clen;++i) cpad[i] = c[i - crypto_box_BOXZEROBYTES];
-    unsigned char mpad[clen];
-    if (::crypto_box_open(mpad,cpad,clen,
-                        (const unsigned char *) n.c_str(),
-                        (const unsigned char *) pk.c_str(),
-                        (const unsigned char *) sk.c_str()
-                        ) != 0)
+    if (c.size() < crypto_box_MACBYTES)
+        throw sodiumpp::crypto_error("ciphertext too short");
+    if (mlen < c.size() - crypto_box_MACBYTES) throw std::invalid_argument("output buffer too small");
+    if (::crypto_box_open_easy(m,c.data(),c.size(),n.data(),pk.data(),sk.data()) != 0)
         throw sodiumpp::crypto_error("ciphertext fails verification");
-    if (clen < crypto_box_ZEROBYTES)
-        throw sodiumpp::crypto_error("ciphertext too short"); // should have been caught by _open
-    return std::string(
-                  (char *) mpad + crypto_box_ZEROBYTES,
-                  clen - crypto_box_ZEROBYTES
-                  );
+    return c.size() - crypto_box_MACBYTES;
 }
 
 std::string sodiumpp::crypto_hash(const std::string &m)
 {
-    unsigned char h[crypto_hash_BYTES];
-    ::crypto_hash(h,(const unsigned char *) m.c_str(),m.size());
-    return std::string((char *) h,sizeof h);
+    std::string h(crypto_hash_BYTES, 0);
+    crypto_hash((unsigned char *)&h[0],h.size(),m);
+    return h;
+}
+
+size_t sodiumpp::crypto_hash(unsigned char *h,size_t hlen,bytes_view m)
+{
+    if (hlen < crypto_hash_BYTES) throw std::invalid_argument("output buffer too small");
+    ::crypto_hash(h,m.data(),m.size());
+    return crypto_hash_BYTES;
 }
 
 std::string sodiumpp::crypto_generichash(const std::string &m, size_t output_len, const std::string &k) {
 	std::string h(output_len, 0);
 	assert(h.size() == output_len);
-	::crypto_generichash(reinterpret_cast<unsigned char *>(&h[0]), h.size(),
-						reinterpret_cast<const unsigned char *>(m.c_str()), m.size(),
-						reinterpret_cast<const unsigned char *>(k.c_str()), k.size());
+	crypto_generichash(reinterpret_cast<unsigned char *>(&h[0]), h.size(), m, k);
 	return h;
 }
 
+size_t sodiumpp::crypto_generichash(unsigned char *h, size_t hlen, bytes_view m, bytes_view k) {
+	::crypto_generichash(h, hlen, m.data(), m.size(), k.data(), k.size());
+	return hlen;
+}
+
 
 std::string sodiumpp::crypto_onetimeauth(const std::string &m,const std::string &k)
+{
+    std::string a(crypto_onetimeauth_BYTES, 0);
+    crypto_onetimeauth((unsigned char *)&a[0],a.size(),m,k);
+    return a;
+}
+
+size_t sodiumpp::crypto_onetimeauth(unsigned char *a,size_t alen,bytes_view m,bytes_view k)
 {
     if (k.size() != crypto_onetimeauth_KEYBYTES) throw std::invalid_argument("incorrect key length");
-    unsigned char a[crypto_onetimeauth_BYTES];
-    ::crypto_onetimeauth(a,(const unsigned char *) m.c_str(),m.size(),(const unsigned char *) k.c_str());
-    return std::string((char *) a,crypto_onetimeauth_BYTES);
+    if (alen < crypto_onetimeauth_BYTES) throw std::invalid_argument("output buffer too small");
+    ::crypto_onetimeauth(a,m.data(),m.size(),k.data());
+    return crypto_onetimeauth_BYTES;
 }
 
 void sodiumpp::crypto_onetimeauth_verify(const std::string &a,const std::string &m,const std::string &k)
+{
+    crypto_onetimeauth_verify(bytes_view(a),bytes_view(m),bytes_view(k));
+}
+
+void sodiumpp::crypto_onetimeauth_verify(bytes_view a,bytes_view m,bytes_view k)
 {
     if (k.size() != crypto_onetimeauth_KEYBYTES) throw std::invalid_argument("incorrect key length");
     if (a.size() != crypto_onetimeauth_BYTES) throw std::invalid_argument("incorrect authenticator length");
-    if (::crypto_onetimeauth_verify(
-                                  (const unsigned char *) a.c_str(),
-                                  (const unsigned char *) m.c_str(),m.size(),
-                                  (const unsigned char *) k.c_str()) == 0) return;
+    if (::crypto_onetimeauth_verify(a.data(),m.data(),m.size(),k.data()) == 0) return;
     throw sodiumpp::crypto_error("invalid authenticator");
 }
 
 std::string sodiumpp::crypto_scalarmult_base(const std::string &n)
 {
-    unsigned char q[crypto_scalarmult_BYTES];
+    std::string q(crypto_scalarmult_BYTES, 0);
+    crypto_scalarmult_base((unsigned char *)&q[0],q.size(),n);
+    return q;
+}
+
+size_t sodiumpp::crypto_scalarmult_base(unsigned char *q,size_t qlen,bytes_view n)
+{
     if (n.size() != crypto_scalarmult_SCALARBYTES) throw std::invalid_argument("incorrect scalar length");
-    ::crypto_scalarmult_base(q,(const unsigned char *) n.c_str());
-    return std::string((char *) q,sizeof q);
+    if (qlen < crypto_scalarmult_BYTES) throw std::invalid_argument("output buffer too small");
+    ::crypto_scalarmult_base(q,n.data());
+    return crypto_scalarmult_BYTES;
 }
 
 std::string sodiumpp::crypto_scalarmult(const std::string &n,const std::string &p)
 {
-    unsigned char q[crypto_scalarmult_BYTES];
+    std::string q(crypto_scalarmult_BYTES, 0);
+    crypto_scalarmult((unsigned char *)&q[0],q.size(),n,p);
+    return q;
+}
+
+size_t sodiumpp::crypto_scalarmult(unsigned char *q,size_t qlen,bytes_view n,bytes_view p)
+{
     if (n.size() != crypto_scalarmult_SCALARBYTES) throw std::invalid_argument("incorrect scalar length");
     if (p.size() != crypto_scalarmult_BYTES) throw std::invalid_argument("incorrect element length");
-    ::crypto_scalarmult(q,(const unsigned char *) n.c_str(),(const unsigned char *) p.c_str());
-    return std::string((char *) q,sizeof q);
+    if (qlen < crypto_scalarmult_BYTES) throw std::invalid_argument("output buffer too small");
+    ::crypto_scalarmult(q,n.data(),p.data());
+    return crypto_scalarmult_BYTES;
 }
 
 std::string sodiumpp::crypto_secretbox(const std::string &m,const std::string &n,const std::string &k)
+{
+    std::string c(m.size() + crypto_secretbox_MACBYTES, 0);
+    crypto_secretbox((unsigned char *)&c[0],c.size(),m,n,k);
+    return c;
+}
+
+size_t sodiumpp::crypto_secretbox(unsigned char *c,size_t clen,bytes_view m,bytes_view n,bytes_view k)
 {
     if (k.size() != crypto_secretbox_KEYBYTES) throw std::invalid_argument("incorrect key length");
     if (n.size() != crypto_secretbox_NONCEBYTES) throw std::invalid_argument("incorrect nonce length");
-    size_t mlen = m.size() + crypto_secretbox_ZEROBYTES;
-    unsigned char mpad[mlen];
-    for (size_t i = 0;i < crypto_secretbox_ZEROBYTES;++i) mpad[i] = 0;
-    for (size_t i = crypto_secretbox_ZEROBYTES;i < mlen;++i) mpad[i] = m[i - crypto_secretbox_ZEROBYTES];
-    unsigned char cpad[mlen];
-    ::crypto_secretbox(cpad,mpad,mlen,(const unsigned char *) n.c_str(),(const unsigned char *) k.c_str());
-    return std::string(
-                  (char *) cpad + crypto_secretbox_BOXZEROBYTES,
-                  mlen - crypto_secretbox_BOXZEROBYTES
-                  );
+    if (clen < m.size() + crypto_secretbox_MACBYTES) throw std::invalid_argument("output buffer too small");
+    ::crypto_secretbox_easy(c,m.data(),m.size(),n.data(),k.data());
+    return m.size() + crypto_secretbox_MACBYTES;
 }
 
 std::string sodiumpp::crypto_secretbox_open(const std::string &c,const std::string &n,const std::string &k)
+{
+    std::string m(c.size() < crypto_secretbox_MACBYTES ? 0 : c.size() - crypto_secretbox_MACBYTES, 0);
+    crypto_secretbox_open((unsigned char *)&m[0],m.size(),c,n,k);
+    return m;
+}
+
+size_t sodiumpp::crypto_secretbox_open(unsigned char *m,size_t mlen,bytes_view c,bytes_view n,bytes_view k)
 {
     if (k.size() != crypto_secretbox_KEYBYTES) throw std::invalid_argument("incorrect key length");
     if (n.size() != crypto_secretbox_NONCEBYTES) throw std::invalid_argument("incorrect nonce length");
-    size_t clen = c.size() + crypto_secretbox_BOXZEROBYTES;
-    unsigned char cpad[clen];
-    for (size_t i = 0;i < crypto_secretbox_BOXZEROBYTES;++i) cpad[i] = 0;
-    for (size_t i = crypto_secretbox_BOXZEROBYTES;i < clen;++i) cpad[i] = c[i - crypto_secretbox_BOXZEROBYTES];
-    unsigned char mpad[clen];
-    if (::crypto_secretbox_open(mpad,cpad,clen,(const unsigned char *) n.c_str(),(const unsigned char *) k.c_str()) != 0)
+    if (c.size() < crypto_secretbox_MACBYTES)
+        throw sodiumpp::crypto_error("ciphertext too short");
+    if (mlen < c.size() - crypto_secretbox_MACBYTES) throw std::invalid_argument("output buffer too small");
+    if (::crypto_secretbox_open_easy(m,c.data(),c.size(),n.data(),k.data()) != 0)
         throw sodiumpp::crypto_error("ciphertext fails verification");
-    if (clen < crypto_secretbox_ZEROBYTES)
-        throw sodiumpp::crypto_error("ciphertext too short"); // should have been caught by _open
-    return std::string(
-                  (char *) mpad + crypto_secretbox_ZEROBYTES,
-                  clen - crypto_secretbox_ZEROBYTES
-                  );
+    return c.size() - crypto_secretbox_MACBYTES;
 }
 
 std::string sodiumpp::crypto_sign_keypair(std::string &sk_string)
 {
-    unsigned char pk[crypto_sign_PUBLICKEYBYTES];
+    std::string pk(crypto_sign_PUBLICKEYBYTES, 0);
     sk_string.resize(crypto_sign_SECRETKEYBYTES, 0);
-    ::crypto_sign_keypair(pk,(unsigned char *)&sk_string[0]);
-    return std::string((char *) pk,sizeof pk);
+    crypto_sign_keypair((unsigned char *)&pk[0],pk.size(),(unsigned char *)&sk_string[0],sk_string.size());
+    return pk;
+}
+
+void sodiumpp::crypto_sign_keypair(unsigned char *pk,size_t pklen,unsigned char *sk,size_t sklen)
+{
+    if (pklen != crypto_sign_PUBLICKEYBYTES) throw std::invalid_argument("incorrect public-key length");
+    if (sklen != crypto_sign_SECRETKEYBYTES) throw std::invalid_argument("incorrect secret-key length");
+    ::crypto_sign_keypair(pk,sk);
 }
 
 std::string sodiumpp::crypto_sign_open(const std::string &sm_string, const std::string &pk_string)
 {
-    if (pk_string.size() != crypto_sign_PUBLICKEYBYTES) throw std::invalid_argument("incorrect public-key length");
-    size_t smlen = sm_string.size();
-    unsigned char m[smlen];
-    unsigned long long mlen;
-    for (size_t i = 0;i < smlen;++i) m[i] = sm_string[i];
-    if (::crypto_sign_open(
-                         m,
-                         &mlen,
-                         m,
-                         smlen,
-                         (const unsigned char *) pk_string.c_str()
-                         ) != 0)
+    std::string m(sm_string.size() < crypto_sign_BYTES ? 0 : sm_string.size() - crypto_sign_BYTES, 0);
+    crypto_sign_open((unsigned char *)&m[0],m.size(),sm_string,pk_string);
+    return m;
+}
+
+size_t sodiumpp::crypto_sign_open(unsigned char *m,size_t mlen,bytes_view sm,bytes_view pk)
+{
+    if (pk.size() != crypto_sign_PUBLICKEYBYTES) throw std::invalid_argument("incorrect public-key length");
+    if (sm.size() < crypto_sign_BYTES)
+        throw sodiumpp::crypto_error("ciphertext fails verification");
+    if (mlen < sm.size() - crypto_sign_BYTES) throw std::invalid_argument("output buffer too small");
+    unsigned long long mlen_out;
+    if (::crypto_sign_open(m,&mlen_out,sm.data(),sm.size(),pk.data()) != 0)
         throw sodiumpp::crypto_error("ciphertext fails verification");
-    return std::string(
-                  (char *) m,
-                  mlen
-                  );
+    return mlen_out;
 }
 
 std::string sodiumpp::crypto_sign(const std::string &m_string, const std::string &sk_string)
 {
-    if (sk_string.size() != crypto_sign_SECRETKEYBYTES) throw std::invalid_argument("incorrect secret-key length");
-    size_t mlen = m_string.size();
-    unsigned char m[mlen+crypto_sign_BYTES];
-    unsigned long long smlen;
-    for (size_t i = 0;i < mlen;++i) m[i] = m_string[i];
-    ::crypto_sign(
-                m,
-                &smlen,
-                m,
-                mlen,
-                (const unsigned char *) sk_string.c_str()
-                );
-    return std::string(
-                  (char *) m,
-                  smlen
-                  );
+    std::string sm(m_string.size() + crypto_sign_BYTES, 0);
+    crypto_sign((unsigned char *)&sm[0],sm.size(),m_string,sk_string);
+    return sm;
+}
+
+size_t sodiumpp::crypto_sign(unsigned char *sm,size_t smlen,bytes_view m,bytes_view sk)
+{
+    if (sk.size() != crypto_sign_SECRETKEYBYTES) throw std::invalid_argument("incorrect secret-key length");
+    if (smlen < m.size() + crypto_sign_BYTES) throw std::invalid_argument("output buffer too small");
+    unsigned long long smlen_out;
+    ::crypto_sign(sm,&smlen_out,m.data(),m.size(),sk.data());
+    return smlen_out;
+}
+
+std::string sodiumpp::crypto_sign_detached(const std::string &m, const std::string &sk)
+{
+    std::string sig(crypto_sign_BYTES, 0);
+    crypto_sign_detached((unsigned char *)&sig[0],sig.size(),m,sk);
+    return sig;
+}
+
+size_t sodiumpp::crypto_sign_detached(unsigned char *sig,size_t siglen,bytes_view m,bytes_view sk)
+{
+    if (sk.size() != crypto_sign_SECRETKEYBYTES) throw std::invalid_argument("incorrect secret-key length");
+    if (siglen < crypto_sign_BYTES) throw std::invalid_argument("output buffer too small");
+    ::crypto_sign_detached(sig,nullptr,m.data(),m.size(),sk.data());
+    return crypto_sign_BYTES;
+}
+
+void sodiumpp::crypto_sign_verify_detached(const std::string &sig, const std::string &m, const std::string &pk)
+{
+    crypto_sign_verify_detached(bytes_view(sig),bytes_view(m),bytes_view(pk));
+}
+
+void sodiumpp::crypto_sign_verify_detached(bytes_view sig,bytes_view m,bytes_view pk)
+{
+    if (pk.size() != crypto_sign_PUBLICKEYBYTES) throw std::invalid_argument("incorrect public-key length");
+    if (sig.size() != crypto_sign_BYTES || ::crypto_sign_verify_detached(sig.data(),m.data(),m.size(),pk.data()) != 0)
+        throw sodiumpp::crypto_error("signature fails verification");
 }
 
 std::string sodiumpp::crypto_stream(size_t clen,const std::string &n,const std::string &k)
 {
-    if (n.size() != crypto_stream_NONCEBYTES) throw std::invalid_argument("incorrect nonce length");
-    if (k.size() != crypto_stream_KEYBYTES) throw std::invalid_argument("incorrect key length");
-    unsigned char c[clen];
-    ::crypto_stream(c,clen,(const unsigned char *) n.c_str(),(const unsigned char *) k.c_str());
-    return std::string((char *) c,clen);
+    std::string c(clen, 0);
+    crypto_stream((unsigned char *)&c[0],c.size(),n,k);
+    return c;
 }
 
-std::string sodiumpp::crypto_stream_xor(const std::string &m,const std::string &n,const std::string &k)
+size_t sodiumpp::crypto_stream(unsigned char *c,size_t clen,bytes_view n,bytes_view k)
 {
     if (n.size() != crypto_stream_NONCEBYTES) throw std::invalid_argument("incorrect nonce length");
     if (k.size() != crypto_stream_KEYBYTES) throw std::invalid_argument("incorrect key length");
-    size_t mlen = m.size();
-    unsigned char c[mlen];
-    ::crypto_stream_xor(c,
-                      (const unsigned char *) m.c_str(),mlen,
-                      (const unsigned char *) n.c_str(),
-                      (const unsigned char *) k.c_str()
-                      );
-    return std::string((char *) c,mlen);
+    ::crypto_stream(c,clen,n.data(),k.data());
+    return clen;
 }
 
-std::string sodiumpp::bin2hex(const std::string& bytes) {
-    std::string hex(bytes.size()*2, 0);
-    sodium_bin2hex(&hex[0], hex.size(), reinterpret_cast<const unsigned char *>(&bytes[0]), bytes.size());
-    return hex;
+std::string sodiumpp::crypto_stream_xor(const std::string &m,const std::string &n,const std::string &k)
+{
+    std::string c(m.size(), 0);
+    crypto_stream_xor((unsigned char *)&c[0],c.size(),m,n,k);
+    return c;
 }
 
-std::string sodiumpp::hex2bin(const std::string& bytes) {
-    if(bytes.size() % 2 != 0) throw std::invalid_argument("length must be even");
-    std::string bin(bytes.size()/2, 0);
-    size_t binlen;
-    sodium_hex2bin((unsigned char *)&bin[0], bin.size(), &bytes[0], bytes.size(), nullptr, &binlen, nullptr);
-    if(binlen != bin.size()) throw std::invalid_argument("string must be all hexadecimal digits");
-    return bin;
+size_t sodiumpp::crypto_stream_xor(unsigned char *c,size_t clen,bytes_view m,bytes_view n,bytes_view k)
+{
+    if (n.size() != crypto_stream_NONCEBYTES) throw std::invalid_argument("incorrect nonce length");
+    if (k.size() != crypto_stream_KEYBYTES) throw std::invalid_argument("incorrect key length");
+    if (clen < m.size()) throw std::invalid_argument("output buffer too small");
+    ::crypto_stream_xor(c,m.data(),m.size(),n.data(),k.data());
+    return m.size();
 }
 
 void sodiumpp::memzero(std::string& bytes) {
@@ -329,37 +411,54 @@ void sodiumpp::munlock(std::string& bytes) {
     sodium_munlock((unsigned char *)&bytes[0], bytes.size());
 }
 
+void sodiumpp::init() {
+    static const bool initialized = sodium_init() != -1;
+    if (!initialized) throw std::runtime_error("libsodium could not be initialized");
+}
+
 std::string sodiumpp::crypto_shorthash(const std::string& m, const std::string& k) {
-    if(k.size() != crypto_shorthash_KEYBYTES) throw std::invalid_argument("incorrect key length");
     std::string out(crypto_shorthash_BYTES, 0);
-    ::crypto_shorthash((unsigned char *)&out[0], (const unsigned char *)&m[0], m.size(), (const unsigned char *)&k[0]);
+    crypto_shorthash((unsigned char *)&out[0], out.size(), m, k);
     return out;
 }
 
+size_t sodiumpp::crypto_shorthash(unsigned char *out, size_t outlen, bytes_view m, bytes_view k) {
+    if(k.size() != crypto_shorthash_KEYBYTES) throw std::invalid_argument("incorrect key length");
+    if(outlen < crypto_shorthash_BYTES) throw std::invalid_argument("output buffer too small");
+    ::crypto_shorthash(out, m.data(), m.size(), k.data());
+    return crypto_shorthash_BYTES;
+}
+
 std::string sodiumpp::randombytes(size_t size) {
     std::string buf(size, 0);
     randombytes_buf(&buf[0], size);
     return buf;
 }
 
-std::string sodiumpp::encode_from_binary(const std::string& binary_bytes, sodiumpp::encoding enc) {
+std::string sodiumpp::encode_from_binary(bytes_view binary_bytes, sodiumpp::encoding enc) {
     switch(enc) {
         case encoding::binary:
-            return binary_bytes;
-        case encoding::hex:
-            return bin2hex(binary_bytes);
+            return binary_bytes.str();
+        case encoding::hex: {
+            std::string hex(binary_bytes.size() * 2, 0);
+            bin2hex(&hex[0], hex.size(), binary_bytes);
+            return hex;
+        }
         case encoding::z85:
-            return z85::encode_with_padding(binary_bytes);
+            return z85::encode_with_padding(reinterpret_cast<const char *>(binary_bytes.data()), binary_bytes.size());
     }
 }
 
-std::string sodiumpp::decode_to_binary(const std::string& encoded_bytes, sodiumpp::encoding enc) {
+std::string sodiumpp::decode_to_binary(bytes_view encoded_bytes, sodiumpp::encoding enc) {
     switch(enc) {
         case encoding::binary:
-            return encoded_bytes;
-        case encoding::hex:
-            return hex2bin(encoded_bytes);
+            return encoded_bytes.str();
+        case encoding::hex: {
+            std::string bin(encoded_bytes.size() / 2, 0);
+            hex2bin(reinterpret_cast<unsigned char *>(&bin[0]), bin.size(), encoded_bytes);
+            return bin;
+        }
         case encoding::z85:
-            return z85::decode_with_padding(encoded_bytes);
+            return z85::decode_with_padding(reinterpret_cast<const char *>(encoded_bytes.data()), encoded_bytes.size());
     }
 }
@@ -0,0 +1,80 @@
+// Copyright (c) 2014, Ruben De Visscher
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <sodiumpp/sodiumpp.h>
+#include <algorithm>
+#include <cstring>
+
+static_assert(crypto_stream_KEYBYTES == crypto_stream_xsalsa20_KEYBYTES && crypto_stream_NONCEBYTES == crypto_stream_xsalsa20_NONCEBYTES,
+              "crypto_stream must be XSalsa20");
+
+namespace {
+    const size_t block_bytes = 64;
+    // Each task handles this many bytes, a multiple of the block size
+    const size_t range_bytes = 64 * 1024;
+
+    /** XORs len bytes at m into c with the keystream from stream position offset, which is a multiple of block_bytes */
+    void xor_blocks(unsigned char *c, const unsigned char *m, size_t len, unsigned long long offset, const unsigned char *n, const unsigned char *k) {
+        crypto_stream_xsalsa20_xor_ic(c, m, len, n, offset / block_bytes, k);
+    }
+}
+
+sodiumpp::stream_cipher::stream_cipher(bytes_view n, bytes_view k) {
+    if(n.size() != crypto_stream_NONCEBYTES) throw std::invalid_argument("incorrect nonce length");
+    if(k.size() != crypto_stream_KEYBYTES) throw std::invalid_argument("incorrect key length");
+    std::copy(n.begin(), n.end(), this->n);
+    std::copy(k.begin(), k.end(), this->k.data());
+}
+
+void sodiumpp::stream_cipher::xor_at(unsigned char *c, size_t clen, bytes_view m, unsigned long long offset, executor *ex) const {
+    if(clen < m.size()) throw std::invalid_argument("output buffer too small");
+    if(m.size() > ~0ULL - offset) throw std::invalid_argument("offset too large");
+    const unsigned char *in = m.data();
+    size_t len = m.size();
+
+    // A partial first block is XORed through a buffer holding the whole block
+    size_t head = std::min<size_t>(len, (block_bytes - offset % block_bytes) % block_bytes);
+    if(head > 0) {
+        size_t skip = offset % block_bytes;
+        unsigned char block[block_bytes] = {0};
+        std::memcpy(block + skip, in, head);
+        xor_blocks(block, block, block_bytes, offset - skip, n, k.data());
+        std::memcpy(c, block + skip, head);
+        sodium_memzero(block, sizeof(block));
+        c += head;
+        in += head;
+        len -= head;
+        offset += head;
+    }
+
+    size_t ranges = (len + range_bytes - 1) / range_bytes;
+    parallel_for(ex, ranges, 1, [&](size_t begin, size_t end) {
+        size_t from = begin * range_bytes, to = std::min(len, end * range_bytes);
+        xor_blocks(c + from, in + from, to - from, offset + from, n, k.data());
+    });
+}
+
+void sodiumpp::stream_cipher::keystream_at(unsigned char *c, size_t len, unsigned long long offset, executor *ex) const {
+    std::memset(c, 0, len);
+    xor_at(c, len, bytes_view(c, len), offset, ex);
+}
@@ -7,7 +7,12 @@
 //
 
 #include <iostream>
+#include <set>
+#include <thread>
+#include <system_error>
+#include <unistd.h>
 #include <sodiumpp/sodiumpp.h>
+#include <sodiumpp/z85.h>
 #include <bandit/bandit.h>
 
 using namespace sodiumpp;
@@ -31,6 +36,114 @@ go_bandit([](){
         });
     });
     
+    describe("z85 kernels", [](){
+        it("encode like the scalar code", [&](){
+            for(size_t size = 0; size <= 1024; size += 4) {
+                std::string m = randombytes(size);
+                std::string simd(size / 4 * 5, 0), scalar(size / 4 * 5, 0);
+                Z85_encode_unsafe(m.data(), m.data() + size, &simd[0]);
+                Z85_encode_unsafe_scalar(m.data(), m.data() + size, &scalar[0]);
+                AssertThat(simd, Equals(scalar));
+            }
+        });
+
+        it("decode like the scalar code", [&](){
+            for(size_t size = 0; size <= 1024; size += 4) {
+                std::string m = randombytes(size);
+                std::string encoded(size / 4 * 5, 0);
+                Z85_encode_unsafe_scalar(m.data(), m.data() + size, &encoded[0]);
+                std::string simd(size, 0), scalar(size, 0);
+                Z85_decode_unsafe(encoded.data(), encoded.data() + encoded.size(), &simd[0]);
+                AssertThat(simd, Equals(m));
+
+                // Symbols outside the alphabet must decode exactly as before as well
+                std::string noise = randombytes(encoded.size());
+                for(size_t i = 0; i < encoded.size(); ++i) {
+                    if((noise[i] & 0x3f) == 0) encoded[i] = noise[i];
+                }
+                Z85_decode_unsafe(encoded.data(), encoded.data() + encoded.size(), &simd[0]);
+                Z85_decode_unsafe_scalar(encoded.data(), encoded.data() + encoded.size(), &scalar[0]);
+                AssertThat(simd, Equals(scalar));
+            }
+        });
+    });
+
+    describe("z85 streams", [](){
+        // Feeds s to f in the given chunk sizes, then in chunks of random sizes, appending what f writes
+        // to buffers of exactly bound(n) bytes
+        auto chunked = [](const std::string& s, size_t (*bound)(size_t), std::function<size_t(const char*, size_t, char*)> f,
+                          std::vector<size_t> sizes = std::vector<size_t>()) {
+            std::string out;
+            size_t i = 0, chunk = 0;
+            while(i < s.size()) {
+                size_t n = std::min<size_t>(s.size() - i, chunk < sizes.size() ? sizes[chunk++] : randombytes_uniform(23));
+                std::unique_ptr<char[]> buf(new char[bound(n)]);
+                size_t written = f(s.data() + i, n, buf.get());
+                AssertThat(written <= bound(n), IsTrue());
+                out.append(buf.get(), written);
+                i += n;
+            }
+            return out;
+        };
+
+        it("encode and decode padded streams in any chunks", [&](){
+            for(size_t size = 0; size <= 200; ++size) {
+                std::string m = randombytes(size);
+                z85::encoder enc(size);
+                std::string encoded = chunked(m, z85::encoder::updateBound, [&](const char *src, size_t n, char *dst) { return enc.update(src, n, dst); });
+                char last[z85::encoder::finishBound];
+                encoded.append(last, enc.finish(last));
+                AssertThat(encoded, Equals(z85::encode_with_padding(m)));
+
+                z85::decoder dec;
+                std::string decoded = chunked(encoded, z85::decoder::updateBound, [&](const char *src, size_t n, char *dst) { return dec.update(src, n, dst); });
+                decoded.append(last, dec.finish(last));
+                AssertThat(decoded, Equals(m));
+            }
+        });
+
+        it("decode padded streams within updateBound across chunk boundaries", [&](){
+            std::string m = randombytes(8);
+            std::string encoded = z85::encode_with_padding(m);
+            z85::decoder dec;
+            std::string decoded = chunked(encoded, z85::decoder::updateBound, [&](const char *src, size_t n, char *dst) { return dec.update(src, n, dst); }, {6, 5});
+            char last[z85::decoder::finishBound];
+            decoded.append(last, dec.finish(last));
+            AssertThat(decoded, Equals(m));
+        });
+
+        it("encode and decode unpadded streams in any chunks", [&](){
+            for(size_t size = 0; size <= 200; size += 4) {
+                std::string m = randombytes(size);
+                z85::encoder enc;
+                std::string encoded = chunked(m, z85::encoder::updateBound, [&](const char *src, size_t n, char *dst) { return enc.update(src, n, dst); });
+                char last[z85::encoder::finishBound];
+                AssertThat(enc.finish(last), Equals(0u));
+                AssertThat(encoded, Equals(z85::encode(m)));
+
+                z85::decoder dec(false);
+                std::string decoded = chunked(encoded, z85::decoder::updateBound, [&](const char *src, size_t n, char *dst) { return dec.update(src, n, dst); });
+                AssertThat(dec.finish(last), Equals(0u));
+                AssertThat(decoded, Equals(m));
+            }
+        });
+
+        it("rejects misuse", [&](){
+            char buf[16];
+            z85::encoder enc(3);
+            AssertThrows(std::invalid_argument, enc.update("abcd", 4, buf));
+            AssertThrows(std::invalid_argument, enc.finish(buf));
+            z85::encoder unpadded;
+            unpadded.update("abc", 3, buf);
+            AssertThrows(std::invalid_argument, unpadded.finish(buf));
+            z85::decoder dec;
+            AssertThrows(std::invalid_argument, dec.update("5abcde", 6, buf));
+            z85::decoder truncated;
+            truncated.update("3abc", 4, buf);
+            AssertThrows(std::invalid_argument, truncated.finish(buf));
+        });
+    });
+
     describe("hex", [](){
         box_secret_key box_sk;
         sign_secret_key sign_sk;
@@ -46,6 +159,725 @@ go_bandit([](){
             sign_secret_key sign_sk_decoded(sign_sk.pk, encoded);
             AssertThat(sign_sk_decoded.get().to_binary(), Equals(sign_sk.get().to_binary()));
         });
+
+        it("matches libsodium for every length", [&](){
+            for(size_t size = 0; size <= 200; ++size) {
+                std::string m = randombytes(size);
+                std::string expected(2 * size + 1, 0);
+                sodium_bin2hex(&expected[0], expected.size(), reinterpret_cast<const unsigned char *>(m.data()), size);
+                expected.pop_back();
+                AssertThat(bin2hex(m), Equals(expected));
+                AssertThat(bin2hex(m, hex_mode::fast), Equals(expected));
+                AssertThat(hex2bin(expected), Equals(m));
+                AssertThat(hex2bin(expected, hex_mode::fast), Equals(m));
+            }
+            AssertThat(hex2bin("00ABcdEf"), Equals(std::string("\x00\xab\xcd\xef", 4)));
+        });
+
+        it("rejects invalid digits anywhere", [&](){
+            std::string hex = bin2hex(randombytes(100));
+            for(size_t i = 0; i < hex.size(); ++i) {
+                for(char c : { 'g', 'G', '/', ':', '@', '`', ' ', '\xff' }) {
+                    std::string invalid = hex;
+                    invalid[i] = c;
+                    AssertThrows(std::invalid_argument, hex2bin(invalid));
+                    AssertThrows(std::invalid_argument, hex2bin(invalid, hex_mode::fast));
+                }
+            }
+            AssertThrows(std::invalid_argument, hex2bin("abc"));
+        });
+
+        it("zeroes the output buffer on invalid input", [&](){
+            std::string hex = bin2hex(randombytes(64));
+            hex[100] = 'x';
+            std::vector<unsigned char> out(64, 0xaa);
+            AssertThrows(std::invalid_argument, hex2bin(&out[0], out.size(), hex));
+            AssertThat(std::count(out.begin(), out.end(), 0), Equals(64));
+        });
+    });
+
+    describe("encoded_bytes", [](){
+        it("views binary bytes without copying", [&](){
+            std::string m = randombytes(100);
+            encoded_bytes view = encoded_bytes::view(m, encoding::binary);
+            AssertThat(view.is_view(), IsTrue());
+            AssertThat(view.binary().data() == reinterpret_cast<const unsigned char *>(m.data()), IsTrue());
+            AssertThat(view.to(encoding::binary).binary().data() == view.binary().data(), IsTrue());
+            AssertThat(view.to(encoding::hex).bytes, Equals(bin2hex(m)));
+        });
+
+        it("decodes once and shares the result between copies", [&](){
+            std::string m = randombytes(100);
+            std::string z85 = encode_from_binary(m, encoding::z85);
+            encoded_bytes view = encoded_bytes::view(z85, encoding::z85);
+            bytes_view decoded = view.binary();
+            AssertThat(decoded.str(), Equals(m));
+            AssertThat(view.binary().data() == decoded.data(), IsTrue());
+            encoded_bytes copy = view;
+            AssertThat(copy.binary().data() == decoded.data(), IsTrue());
+            AssertThat(view.to(encoding::hex).binary().str(), Equals(m));
+            AssertThat(view.to(encoding::hex).bytes, Equals(bin2hex(m)));
+        });
+
+        it("decodes again after the bytes are changed", [&](){
+            encoded_bytes original(bin2hex("abc"), encoding::hex);
+            AssertThat(original.to_binary(), Equals("abc"));
+            encoded_bytes copy = original;
+            copy.bytes = bin2hex("xyz");
+            AssertThat(copy.to_binary(), Equals("xyz"));
+            AssertThat(original.to_binary(), Equals("abc"));
+            original.bytes[1] = '0';
+            AssertThat(original.to_binary(), Equals(std::string("`bc")));
+            original.bytes = encode_from_binary(std::string("abcd"), encoding::z85);
+            original.enc = encoding::z85;
+            AssertThat(original.to_binary(), Equals("abcd"));
+        });
+
+        it("constructs keys and nonces from views", [&](){
+            box_secret_key sk;
+            std::string hex = sk.pk.get(encoding::hex).bytes;
+            AssertThat(box_public_key(encoded_bytes::view(hex, encoding::hex)), Equals(sk.pk));
+            nonce64 n;
+            std::string binary = n.get().bytes;
+            AssertThat(nonce64(encoded_bytes::view(binary, encoding::binary)), Equals(n));
+            std::string odd("abc");
+            AssertThrows(std::invalid_argument, encoded_bytes::view(odd, encoding::hex).binary());
+        });
+    });
+
+    describe("hashers", [](){
+        std::string m = randombytes(300000);
+        std::string k = randombytes(crypto_generichash_KEYBYTES);
+
+        it("hash messages passed in parts", [&](){
+            sha512_hasher sha512;
+            blake2b_hasher blake2b(crypto_generichash_BYTES_MAX, k);
+            for(size_t i = 0; i < m.size(); i += 1000 + i % 7) {
+                bytes_view part(m.data() + i, std::min<size_t>(m.size() - i, 1000 + i % 7));
+                sha512.update(part);
+                blake2b.update(part);
+            }
+            AssertThat(sha512.final(), Equals(crypto_hash(m)));
+            AssertThat(blake2b.final(), Equals(crypto_generichash(m, crypto_generichash_BYTES_MAX, k)));
+            AssertThrows(std::logic_error, sha512.update(m));
+            AssertThrows(std::logic_error, blake2b.final());
+            AssertThrows(std::invalid_argument, blake2b_hasher(crypto_generichash_BYTES_MAX + 1));
+        });
+
+        it("hash files and file descriptors", [&](){
+            char path[] = "/tmp/sodiumpp-test-XXXXXX";
+            int fd = mkstemp(path);
+            AssertThat(fd >= 0, IsTrue());
+            AssertThat(write(fd, m.data(), m.size()), Equals((ssize_t)m.size()));
+            AssertThat(crypto_hash_file(path), Equals(crypto_hash(m)));
+            AssertThat(crypto_generichash_file(path, crypto_generichash_BYTES, k), Equals(crypto_generichash(m, crypto_generichash_BYTES, k)));
+            lseek(fd, 0, SEEK_SET);
+            AssertThat(crypto_hash_fd(fd), Equals(crypto_hash(m)));
+            lseek(fd, 0, SEEK_SET);
+            blake2b_hasher hasher;
+            AssertThat(hasher.update_fd(fd, 4096), Equals(m.size()));
+            AssertThat(hasher.final(), Equals(crypto_generichash(m, crypto_generichash_BYTES)));
+            close(fd);
+            unlink(path);
+            AssertThrows(std::system_error, crypto_hash_file(path));
+        });
+    });
+
+    describe("tree_hash", [](){
+        std::string m = randombytes(10000);
+        tree_hash_params params(100, 4, 32);
+
+        it("matches the documented construction", [&](){
+            std::string leaves;
+            for(size_t i = 0; i < 100; ++i) {
+                std::string prefix(1, '\0');
+                for(int b = 0; b < 8; ++b) prefix += char(b == 0 ? i : 0);
+                leaves += crypto_generichash(prefix + m.substr(i * 100, 100), 32);
+            }
+            // 100 leaves -> 25 -> 7 -> 2 -> 1
+            while(leaves.size() > 32) {
+                std::string parents;
+                for(size_t i = 0; i < leaves.size(); i += 4 * 32) {
+                    parents += crypto_generichash(std::string(1, '\1') + leaves.substr(i, 4 * 32), 32);
+                }
+                leaves = parents;
+            }
+            std::string root_prefix("\2", 1);
+            for(unsigned long long v : {10000ull, 100ull, 4ull}) {
+                for(int b = 0; b < 8; ++b) root_prefix += char(v >> (8 * b));
+            }
+            tree_hash_result result = tree_hash(m, params);
+            AssertThat(result.leaf_count(), Equals(100u));
+            AssertThat(result.root, Equals(crypto_generichash(root_prefix + leaves, 32)));
+        });
+
+        it("gives the same result on any executor and for files", [&](){
+            tree_hash_result serial = tree_hash(m, params);
+            thread_pool pool(4);
+            tree_hash_result parallel = tree_hash(m, params, &pool);
+            AssertThat(parallel.root, Equals(serial.root));
+            AssertThat(parallel.leaves, Equals(serial.leaves));
+
+            char path[] = "/tmp/sodiumpp-test-XXXXXX";
+            int fd = mkstemp(path);
+            AssertThat(write(fd, m.data(), m.size()), Equals((ssize_t)m.size()));
+            close(fd);
+            tree_hash_result file = tree_hash_file(path, params, &pool);
+            unlink(path);
+            AssertThat(file.root, Equals(serial.root));
+            AssertThat(file.leaves, Equals(serial.leaves));
+        });
+
+        it("verifies ranges against the leaf digests", [&](){
+            tree_hash_result result = tree_hash(m.substr(0, 9950), params);
+            AssertThat(result.leaf_count(), Equals(100u));
+            AssertThat(tree_hash_leaf(bytes_view(m.data() + 4200, 100), 42, params), Equals(result.leaf(42).str()));
+            AssertThat(tree_hash_leaf(bytes_view(m.data() + 4200, 100), 43, params) == result.leaf(43).str(), IsFalse());
+            AssertThat(tree_hash_leaf(bytes_view(m.data() + 9900, 50), 99, params), Equals(result.leaf(99).str()));
+            AssertThat(tree_hash_root(result.leaves, 9950, params), Equals(result.root));
+            AssertThat(tree_hash_root(result.leaves, 9950, tree_hash_params(100, 5, 32)) == result.root, IsFalse());
+            AssertThrows(std::invalid_argument, tree_hash_root(result.leaves, 10001, params));
+            AssertThat(tree_hash(std::string(), params).leaf_count(), Equals(1u));
+            AssertThrows(std::invalid_argument, tree_hash(m, tree_hash_params(100, 1)));
+        });
+    });
+
+    describe("batch hashing", [](){
+        std::vector<std::string> strings;
+        for(size_t i = 0; i < 301; ++i) {
+            // Runs of equal lengths as well as mixed lengths, across block boundaries
+            strings.push_back(randombytes(i < 100 ? i / 4 * 4 % 300 : i < 200 ? 16 + i % 8 : i % 300));
+        }
+        std::vector<bytes_view> messages(strings.begin(), strings.end());
+
+        it("computes the same shorthashes as crypto_shorthash", [&](){
+            std::string k = randombytes(crypto_shorthash_KEYBYTES);
+            thread_pool pool(3);
+            for(executor *ex : {(executor *) nullptr, (executor *) &pool}) {
+                std::string out(messages.size() * crypto_shorthash_BYTES, 0);
+                crypto_shorthash_batch(reinterpret_cast<unsigned char *>(&out[0]), out.size(), messages, k, ex);
+                for(size_t i = 0; i < messages.size(); ++i) {
+                    AssertThat(out.substr(i * crypto_shorthash_BYTES, crypto_shorthash_BYTES), Equals(crypto_shorthash(strings[i], k)));
+                }
+            }
+            unsigned char small[crypto_shorthash_BYTES];
+            AssertThrows(std::invalid_argument, crypto_shorthash_batch(small, sizeof(small), messages, k));
+        });
+
+        it("computes the same generic hashes as crypto_generichash", [&](){
+            thread_pool pool(3);
+            for(size_t key_len : {0u, 16u, 32u, 64u}) {
+                std::string k = randombytes(key_len);
+                for(size_t hash_len : {16u, 32u, 33u, 64u}) {
+                    std::string out(messages.size() * hash_len, 0);
+                    crypto_generichash_batch(reinterpret_cast<unsigned char *>(&out[0]), out.size(), hash_len, messages, k, &pool);
+                    for(size_t i = 0; i < messages.size(); ++i) {
+                        AssertThat(out.substr(i * hash_len, hash_len), Equals(crypto_generichash(strings[i], hash_len, k)));
+                    }
+                }
+            }
+            unsigned char out[64];
+            AssertThrows(std::invalid_argument, crypto_generichash_batch(out, sizeof(out), 8, messages));
+        });
+    });
+
+    describe("keys", [](){
+        box_secret_key box_sk;
+
+        it("exposes key bytes without copying", [&](){
+            AssertThat(std::string(reinterpret_cast<const char *>(box_sk.data()), box_sk.size()), Equals(box_sk.get().to_binary()));
+            AssertThat(std::string(reinterpret_cast<const char *>(box_sk.pk.data()), box_sk.pk.size()), Equals(box_sk.pk.get().to_binary()));
+        });
+
+        it("compares keys", [&](){
+            box_secret_key copy(box_sk);
+            box_secret_key other;
+            AssertThat(copy == box_sk, IsTrue());
+            AssertThat(other == box_sk, IsFalse());
+            AssertThat(box_sk.pk < other.pk, Equals(box_sk.pk.get().to_binary() < other.pk.get().to_binary()));
+        });
+
+        it("rejects keys of the wrong length", [&](){
+            AssertThrows(std::invalid_argument, box_public_key(encoded_bytes("short", encoding::binary)));
+            AssertThrows(std::invalid_argument, box_secret_key(box_sk.pk, encoded_bytes("short", encoding::binary)));
+        });
+    });
+
+    describe("secure_pool", [](){
+        it("gives each key one slot", [&](){
+            size_t before = secure_pool::instance().in_use();
+            {
+                box_secret_key sk;
+                boxer<nonce64> b(sk.pk, sk);
+                AssertThat(secure_pool::instance().in_use(), Equals(before + 2));
+            }
+            AssertThat(secure_pool::instance().in_use(), Equals(before));
+        });
+
+        it("reuses zeroed slots without growing", [&](){
+            secure_pool& pool = secure_pool::instance();
+            std::vector<unsigned char *> slots;
+            for(size_t i = 0; i < 3 * secure_pool::slots_per_chunk; ++i) {
+                slots.push_back(pool.allocate());
+                slots.back()[0] = 0xaa;
+            }
+            size_t capacity = pool.capacity();
+            for(unsigned char *slot : slots) pool.deallocate(slot);
+            for(unsigned char *&slot : slots) {
+                slot = pool.allocate();
+                AssertThat(slot[0], Equals(0));
+            }
+            AssertThat(pool.capacity(), Equals(capacity));
+            for(unsigned char *slot : slots) pool.deallocate(slot);
+        });
+    });
+
+    describe("shared_key_cache", [](){
+        box_secret_key sk_client;
+        box_secret_key sk_server;
+
+        it("reuses cached parameters", [&](){
+            shared_key_cache cache(16);
+            boxer<nonce64> cached(sk_server.pk, sk_client, cache);
+            boxer<nonce64> second(sk_server.pk, sk_client, cached.get_nonce_constant(), cache);
+            AssertThat(cache.misses(), Equals(1u));
+            AssertThat(cache.hits(), Equals(1u));
+
+            unboxer<nonce64> server(sk_client.pk, sk_server, cached.get_nonce_constant(), cache);
+            AssertThat(cache.misses(), Equals(2u));
+            AssertThat(server.unbox(cached.box("cached")), Equals("cached"));
+            AssertThat(second.box("again").bytes, Equals(boxer<nonce64>(sk_server.pk, sk_client, cached.get_nonce_constant()).box("again").bytes));
+        });
+
+        it("evicts entries when full", [&](){
+            shared_key_cache cache(1);
+            std::vector<box_secret_key> peers(3);
+            for(int round = 0; round < 2; ++round) {
+                for(box_secret_key& peer : peers) {
+                    boxer<nonce64> b(peer.pk, sk_client, cache);
+                    unboxer<nonce64> u(sk_client.pk, peer, b.get_nonce_constant());
+                    AssertThat(u.unbox(b.box("evicted")), Equals("evicted"));
+                }
+            }
+            AssertThat(cache.capacity(), Equals(1u));
+            AssertThat(cache.misses(), Equals(6u));
+        });
+
+        it("can be shared between threads", [&](){
+            shared_key_cache cache(64);
+            std::vector<box_secret_key> peers(8);
+            std::vector<std::thread> threads;
+            std::atomic<int> failures(0);
+            for(int t = 0; t < 4; ++t) {
+                threads.push_back(std::thread([&](){
+                    for(int i = 0; i < 50; ++i) {
+                        box_secret_key& peer = peers[i % peers.size()];
+                        boxer<nonce64> b(peer.pk, sk_client, cache);
+                        unboxer<nonce64> u(sk_client.pk, peer, b.get_nonce_constant());
+                        if(u.unbox(b.box("shared")) != "shared") ++failures;
+                    }
+                }));
+            }
+            for(std::thread& t : threads) t.join();
+            AssertThat(failures.load(), Equals(0));
+            AssertThat(cache.hits() + cache.misses(), Equals(200u));
+            AssertThat(cache.misses() < 200u, IsTrue());
+        });
+    });
+
+    describe("buffer api", [](){
+        std::string sk;
+        std::string pk = crypto_box_keypair(sk);
+        std::string n = randombytes(crypto_box_NONCEBYTES);
+        std::string m = "Hello, world!";
+
+        it("writes the same bytes as the string api", [&](){
+            std::string c(m.size() + crypto_box_MACBYTES, 0);
+            size_t clen = crypto_box((unsigned char *)&c[0], c.size(), m, n, pk, sk);
+            AssertThat(clen, Equals(c.size()));
+            AssertThat(c, Equals(crypto_box(m, n, pk, sk)));
+
+            std::string opened(m.size(), 0);
+            size_t mlen = crypto_box_open((unsigned char *)&opened[0], opened.size(), c, n, pk, sk);
+            AssertThat(mlen, Equals(m.size()));
+            AssertThat(opened, Equals(m));
+        });
+
+        it("rejects output buffers that are too small", [&](){
+            unsigned char c[crypto_box_MACBYTES];
+            AssertThrows(std::invalid_argument, crypto_box(c, sizeof c, m, n, pk, sk));
+        });
+    });
+
+    describe("large messages", [](){
+        // Larger than a default thread stack, so this would crash if any of these used stack buffers
+        std::string m = randombytes(16 * 1024 * 1024);
+        std::string n = randombytes(crypto_box_NONCEBYTES);
+
+        it("can box and unbox", [&](){
+            std::string sk;
+            std::string pk = crypto_box_keypair(sk);
+            AssertThat(crypto_box_open(crypto_box(m, n, pk, sk), n, pk, sk) == m, IsTrue());
+        });
+
+        it("can secretbox and open", [&](){
+            std::string k = randombytes(crypto_secretbox_KEYBYTES);
+            AssertThat(crypto_secretbox_open(crypto_secretbox(m, n, k), n, k) == m, IsTrue());
+        });
+
+        it("can sign and verify", [&](){
+            std::string sk;
+            std::string pk = crypto_sign_keypair(sk);
+            AssertThat(crypto_sign_open(crypto_sign(m, sk), pk) == m, IsTrue());
+        });
+
+        it("can stream", [&](){
+            std::string k = randombytes(crypto_stream_KEYBYTES);
+            AssertThat(crypto_stream_xor(crypto_stream_xor(m, n, k), n, k) == m, IsTrue());
+            AssertThat(crypto_stream(m.size(), n, k).size(), Equals(m.size()));
+        });
+    });
+
+    describe("boxer", [](){
+        box_secret_key sk_client;
+        box_secret_key sk_server;
+        std::string m = "Hello, world!";
+
+        it("can box in place with the mac in front", [&](){
+            boxer<nonce64> client_boxer(sk_server.pk, sk_client);
+            boxer<nonce64> reference_boxer(sk_server.pk, sk_client, client_boxer.get_nonce_constant());
+            unboxer<nonce64> server_unboxer(sk_client.pk, sk_server, client_boxer.get_nonce_constant());
+
+            std::string buf = std::string(crypto_box_MACBYTES, 0) + m;
+            nonce64 used_n;
+            client_boxer.box_inplace((unsigned char *)&buf[0], m.size(), used_n);
+            AssertThat(buf, Equals(reference_boxer.box(m).bytes));
+
+            size_t mlen = server_unboxer.unbox_inplace((unsigned char *)&buf[0], buf.size());
+            AssertThat(buf.substr(crypto_box_MACBYTES, mlen), Equals(m));
+        });
+
+        it("can box in place with the mac at the back", [&](){
+            boxer<nonce64> client_boxer(sk_server.pk, sk_client);
+            unboxer<nonce64> server_unboxer(sk_client.pk, sk_server, client_boxer.get_nonce_constant());
+
+            std::string buf = m + std::string(crypto_box_MACBYTES, 0);
+            client_boxer.box_inplace((unsigned char *)&buf[0], m.size(), mac_position::back);
+            AssertThat(buf.substr(0, m.size()), Is().Not().EqualTo(m));
+
+            buf[0] ^= 1;
+            AssertThrows(crypto_error, server_unboxer.unbox_inplace((unsigned char *)&buf[0], buf.size(), mac_position::back));
+            buf[0] ^= 1;
+            size_t mlen = server_unboxer.unbox_inplace((unsigned char *)&buf[0], buf.size(), mac_position::back);
+            AssertThat(buf.substr(0, mlen), Equals(m));
+        });
+
+        it("can box and unbox batches", [&](){
+            boxer<nonce64> client_boxer(sk_server.pk, sk_client);
+            boxer<nonce64> reference_boxer(sk_server.pk, sk_client, client_boxer.get_nonce_constant());
+            unboxer<nonce64> server_unboxer(sk_client.pk, sk_server, client_boxer.get_nonce_constant());
+
+            std::vector<std::string> messages = { "first", "", "third message" };
+            std::vector<bytes_view> views(messages.begin(), messages.end());
+            std::string boxed;
+            std::vector<size_t> offsets;
+            client_boxer.box_batch(views, boxed, offsets);
+            AssertThat(offsets.size(), Equals(messages.size() + 1));
+
+            std::vector<bytes_view> boxed_views;
+            for(size_t i = 0; i < messages.size(); ++i) {
+                std::string c = boxed.substr(offsets[i], offsets[i+1] - offsets[i]);
+                AssertThat(c, Equals(reference_boxer.box(messages[i]).bytes));
+                boxed_views.push_back(bytes_view(&boxed[offsets[i]], offsets[i+1] - offsets[i]));
+            }
+            AssertThat(client_boxer.get_nonce() == reference_boxer.get_nonce(), IsTrue());
+
+            std::string unboxed;
+            server_unboxer.unbox_batch(boxed_views, unboxed, offsets);
+            AssertThat(unboxed, Equals("firstthird message"));
+            AssertThat(offsets[2], Equals(5u));
+        });
+
+        it("can box batches in parallel", [&](){
+            boxer<nonce64> client_boxer(sk_server.pk, sk_client);
+            boxer<nonce64> serial_boxer(sk_server.pk, sk_client, client_boxer.get_nonce_constant());
+            thread_pool pool(4);
+
+            std::vector<std::string> messages;
+            for(size_t i = 0; i < 1000; ++i) messages.push_back(randombytes(i % 300));
+            std::vector<bytes_view> views(messages.begin(), messages.end());
+            std::string boxed, serial_boxed;
+            std::vector<size_t> offsets, serial_offsets;
+            nonce64 first_n, serial_first_n;
+            client_boxer.box_batch(views, boxed, offsets, first_n, &pool);
+            serial_boxer.box_batch(views, serial_boxed, serial_offsets, serial_first_n);
+
+            AssertThat(boxed == serial_boxed, IsTrue());
+            AssertThat(offsets, Equals(serial_offsets));
+            AssertThat(first_n == serial_first_n, IsTrue());
+            AssertThat(client_boxer.get_nonce() == serial_boxer.get_nonce(), IsTrue());
+        });
+
+        it("checks the nonce for overflow once per batch", [&](){
+            boxer<nonce<1>> client_boxer(sk_server.pk, sk_client);
+            std::vector<bytes_view> views(200, bytes_view("x", 1));
+            std::string boxed;
+            std::vector<size_t> offsets;
+            nonce<1> before = client_boxer.get_nonce();
+            AssertThrows(std::overflow_error, client_boxer.box_batch(views, boxed, offsets));
+            AssertThat(client_boxer.get_nonce() == before, IsTrue());
+        });
+    });
+
+    describe("concurrent_boxer", [](){
+        box_secret_key sk_client;
+        box_secret_key sk_server;
+
+        it("hands out every nonce once across threads", [&](){
+            concurrent_boxer<nonce64> client_boxer(sk_server.pk, sk_client);
+            unboxer<nonce64> server_unboxer(sk_client.pk, sk_server, client_boxer.get_nonce_constant());
+            std::vector<std::vector<std::string>> nonces(4);
+            std::vector<std::thread> threads;
+            for(size_t t = 0; t < nonces.size(); ++t) {
+                threads.push_back(std::thread([&, t](){
+                    for(size_t i = 0; i < 250; ++i) {
+                        nonce64 used_n;
+                        encoded_bytes boxed = client_boxer.box("message", used_n);
+                        if(server_unboxer.unbox(boxed, used_n) == "message") {
+                            nonces[t].push_back(used_n.get().bytes);
+                        }
+                    }
+                }));
+            }
+            for(std::thread& thread : threads) thread.join();
+
+            std::set<std::string> unique;
+            for(const std::vector<std::string>& thread_nonces : nonces) unique.insert(thread_nonces.begin(), thread_nonces.end());
+            AssertThat(unique.size(), Equals(1000u));
+        });
+
+        it("detects overflow", [&](){
+            concurrent_boxer<nonce<1>> client_boxer(sk_server.pk, sk_client);
+            client_boxer.reserve(100);
+            client_boxer.reserve(28);
+            AssertThrows(std::overflow_error, client_boxer.reserve());
+            AssertThrows(std::overflow_error, client_boxer.reserve(0xffffffffffffffffULL));
+        });
+    });
+
+    describe("detached signatures", [](){
+        sign_secret_key sk;
+        std::string m = randombytes(1000);
+
+        it("sign and verify with the functions", [&](){
+            std::string sig = crypto_sign_detached(m, sk.get().bytes);
+            AssertThat(sig, Equals(crypto_sign(m, sk.get().bytes).substr(0, crypto_sign_BYTES)));
+            crypto_sign_verify_detached(sig, m, sk.pk.get().bytes);
+            AssertThrows(crypto_error, crypto_sign_verify_detached(sig, m + "x", sk.pk.get().bytes));
+            AssertThrows(crypto_error, crypto_sign_verify_detached(sig.substr(1), m, sk.pk.get().bytes));
+        });
+
+        it("sign and verify with signer and verifier", [&](){
+            signer s(sk);
+            verifier v(s.public_key());
+            std::string sig = s.sign(m);
+            AssertThat(v.check(sig, m), IsTrue());
+            v.verify(sig, m);
+            AssertThat(v.check(sig, bytes_view(m.data(), 999)), IsFalse());
+            AssertThrows(crypto_error, v.verify(sig, bytes_view(m.data(), 999)));
+        });
+
+        it("sign and verify messages in parts with Ed25519ph", [&](){
+            signer s(sk);
+            verifier v(sk.pk);
+            for(size_t i = 0; i < m.size(); i += 300) s.update(bytes_view(m.data() + i, std::min<size_t>(300, m.size() - i)));
+            std::string sig = s.final();
+            AssertThat(v.check(sig, m), IsFalse());
+            v.update(m).final(sig);
+            // final() starts a new message
+            AssertThrows(crypto_error, v.update(bytes_view(m.data(), 1)).final(sig));
+            AssertThat(s.final() == sig, IsFalse());
+            v.update(bytes_view(m.data(), 500)).update(bytes_view(m.data() + 500, 500));
+            v.final(sig);
+        });
+    });
+
+    describe("keypair_factory", [](){
+        it("hands out working keypairs from the queue after fill", [&](){
+            box_keypair_factory factory(16);
+            AssertThat(factory.capacity(), Equals(16u));
+            AssertThat(factory.size(), Equals(0u));
+            factory.fill();
+            AssertThat(factory.size(), Equals(16u));
+            std::unique_ptr<box_secret_key> a = factory.pop(), b = factory.pop();
+            AssertThat(factory.size(), Equals(14u));
+            AssertThat(factory.misses(), Equals(0u));
+            AssertThat(a->pk == b->pk, IsFalse());
+            std::string n = randombytes(crypto_box_NONCEBYTES), m("message");
+            std::string c = crypto_box(m, n, b->pk.get().bytes, a->get().bytes);
+            AssertThat(crypto_box_open(c, n, a->pk.get().bytes, b->get().bytes), Equals(m));
+        });
+
+        it("generates keypairs inline when the queue is empty", [&](){
+            sign_keypair_factory factory(3);
+            AssertThat(factory.capacity(), Equals(4u));
+            std::unique_ptr<sign_secret_key> sk = factory.pop();
+            AssertThat(factory.misses(), Equals(1u));
+            std::string m("message");
+            crypto_sign_verify_detached(crypto_sign_detached(m, sk->get().bytes), m, sk->pk.get().bytes);
+            AssertThrows(std::invalid_argument, sign_keypair_factory(0));
+        });
+
+        it("refills on the executor and can be shared between threads", [&](){
+            thread_pool pool(3);
+            std::vector<std::string> public_keys(400);
+            {
+                box_keypair_factory factory(64, &pool, 8);
+                std::vector<std::thread> threads;
+                for(int t = 0; t < 4; ++t) {
+                    threads.emplace_back([&, t](){
+                        for(int i = 0; i < 100; ++i) public_keys[t * 100 + i] = factory.pop()->pk.get().bytes;
+                    });
+                }
+                for(std::thread& thread : threads) thread.join();
+                AssertThat(factory.size() <= factory.capacity(), IsTrue());
+            }
+            std::sort(public_keys.begin(), public_keys.end());
+            AssertThat(std::unique(public_keys.begin(), public_keys.end()) == public_keys.end(), IsTrue());
+        });
+    });
+
+    describe("crypto_sign_verify_batch", [](){
+        it("reports each check in the bitmap without throwing", [&](){
+            std::vector<sign_secret_key> keys(3);
+            std::vector<std::string> messages, signatures;
+            for(size_t i = 0; i < 200; ++i) {
+                messages.push_back(randombytes(i));
+                signatures.push_back(crypto_sign(messages[i], keys[i % 3].get().bytes).substr(0, crypto_sign_BYTES));
+            }
+            std::vector<signature_check> checks;
+            for(size_t i = 0; i < 200; ++i) {
+                checks.push_back(signature_check(messages[i], signatures[i], bytes_view(keys[i % 3].pk.data(), crypto_sign_PUBLICKEYBYTES)));
+            }
+            signatures[5][0] ^= 1;
+            checks[70].pk = bytes_view(keys[(70 + 1) % 3].pk.data(), crypto_sign_PUBLICKEYBYTES);
+            checks[130].sig = bytes_view(signatures[130].data(), 10);
+            std::string tampered = messages[199] + "x";
+            checks[199].m = tampered;
+
+            thread_pool pool(3);
+            for(executor *ex : {(executor *) nullptr, (executor *) &pool}) {
+                verification_results results = crypto_sign_verify_batch(checks, ex);
+                AssertThat(results.size(), Equals(200u));
+                AssertThat(results.passed(), Equals(196u));
+                AssertThat(results.all(), IsFalse());
+                for(size_t i = 0; i < 200; ++i) {
+                    AssertThat(results[i], Equals(i != 5 && i != 70 && i != 130 && i != 199));
+                }
+                AssertThat(results.bitmap().size(), Equals(4u));
+            }
+            AssertThat(crypto_sign_verify_batch(std::vector<signature_check>()).all(), IsTrue());
+        });
+    });
+
+    describe("secretstream", [](){
+        std::string k = randombytes(crypto_secretstream_xchacha20poly1305_KEYBYTES);
+
+        it("can push and pull messages with tags, additional data and rekeying", [&](){
+            secretstream_pusher pusher(k);
+            std::string c1 = pusher.push("first", secretstream_tag::message, "ad");
+            std::string c2 = pusher.push("second", secretstream_tag::rekey);
+            std::string c3 = pusher.push("third");
+            pusher.rekey();
+            std::string c4 = pusher.push("", secretstream_tag::final);
+            AssertThat(pusher.finished(), IsTrue());
+            AssertThrows(std::logic_error, pusher.push("more"));
+
+            secretstream_puller puller(k, pusher.header());
+            secretstream_tag tag;
+            AssertThrows(crypto_error, puller.pull(c1, tag, "wrong ad"));
+            AssertThat(puller.pull(c1, tag, "ad"), Equals("first"));
+            AssertThat(tag == secretstream_tag::message, IsTrue());
+            AssertThrows(crypto_error, puller.pull(c3, tag));
+            AssertThat(puller.pull(c2, tag), Equals("second"));
+            AssertThat(tag == secretstream_tag::rekey, IsTrue());
+            AssertThat(puller.pull(c3, tag), Equals("third"));
+            puller.rekey();
+            AssertThat(puller.pull(c4, tag), Equals(""));
+            AssertThat(tag == secretstream_tag::final, IsTrue());
+            AssertThat(puller.finished(), IsTrue());
+        });
+
+        it("encrypts and decrypts files in chunks", [&](){
+            for(size_t size : {0u, 1000u, 4096u, 10000u}) {
+                std::string m = randombytes(size);
+                char plain[] = "/tmp/sodiumpp-test-XXXXXX", sealed[] = "/tmp/sodiumpp-test-XXXXXX", opened[] = "/tmp/sodiumpp-test-XXXXXX";
+                int plain_fd = mkstemp(plain), sealed_fd = mkstemp(sealed), opened_fd = mkstemp(opened);
+                AssertThat(write(plain_fd, m.data(), m.size()), Equals((ssize_t)m.size()));
+                lseek(plain_fd, 0, SEEK_SET);
+                AssertThat(secretstream_encrypt_fd(plain_fd, sealed_fd, k, 1024), Equals(size));
+                off_t sealed_size = lseek(sealed_fd, 0, SEEK_CUR);
+                AssertThat(sealed_size, Equals((off_t)(crypto_secretstream_xchacha20poly1305_HEADERBYTES + size + (size / 1024 + 1) * crypto_secretstream_xchacha20poly1305_ABYTES)));
+                lseek(sealed_fd, 0, SEEK_SET);
+                AssertThat(secretstream_decrypt_fd(sealed_fd, opened_fd, k, 1024), Equals(size));
+                AssertThat(crypto_hash_file(opened), Equals(crypto_hash(m)));
+
+                // Dropping the final message must be detected
+                AssertThat(ftruncate(sealed_fd, sealed_size - crypto_secretstream_xchacha20poly1305_ABYTES - size % 1024), Equals(0));
+                lseek(sealed_fd, 0, SEEK_SET);
+                AssertThrows(crypto_error, secretstream_decrypt_fd(sealed_fd, opened_fd, k, 1024));
+                for(int fd : {plain_fd, sealed_fd, opened_fd}) close(fd);
+                for(const char *path : {plain, sealed, opened}) unlink(path);
+            }
+        });
+    });
+
+    describe("stream_cipher", [](){
+        std::string n = randombytes(crypto_stream_NONCEBYTES);
+        std::string k = randombytes(crypto_stream_KEYBYTES);
+        std::string m = randombytes(300000);
+        std::string c = crypto_stream_xor(m, n, k);
+        stream_cipher cipher(n, k);
+
+        it("matches crypto_stream_xor from any offset", [&](){
+            for(size_t offset : {0u, 1u, 63u, 64u, 65u, 1000u, 65536u + 7u}) {
+                for(size_t len : {0u, 1u, 10u, 64u, 200u, 70000u}) {
+                    std::string part(len, 0);
+                    cipher.xor_at((unsigned char *)&part[0], part.size(), bytes_view(m.data() + offset, len), offset);
+                    AssertThat(part, Equals(c.substr(offset, len)));
+                }
+            }
+            std::string keystream(1000, 0);
+            cipher.keystream_at((unsigned char *)&keystream[0], keystream.size(), 5);
+            AssertThat(keystream, Equals(crypto_stream(1005, n, k).substr(5)));
+        });
+
+        it("decrypts in place on several threads", [&](){
+            thread_pool pool(4);
+            std::string buf = c.substr(3);
+            cipher.xor_at((unsigned char *)&buf[0], buf.size(), buf, 3, &pool);
+            AssertThat(buf, Equals(m.substr(3)));
+            unsigned char out[1];
+            AssertThrows(std::invalid_argument, cipher.xor_at(out, sizeof(out), bytes_view(m.data(), 1), ~0ULL));
+        });
+    });
+
+    describe("parallel_for", [](){
+        it("covers every index exactly once", [&](){
+            thread_pool pool(3);
+            std::vector<int> seen(10000, 0);
+            parallel_for(&pool, seen.size(), 7, [&](size_t begin, size_t end){
+                for(size_t i = begin; i < end; ++i) seen[i]++;
+            });
+            AssertThat(seen, Is().All().EqualTo(1));
+        });
+
+        it("rethrows exceptions on the calling thread", [&](){
+            thread_pool pool(3);
+            AssertThrows(std::runtime_error, parallel_for(&pool, 100, 1, [](size_t begin, size_t){
+                if(begin == 42) throw std::runtime_error("failed");
+            }));
+        });
     });
 
     describe("nonce", [](){
@@ -66,6 +898,35 @@ go_bandit([](){
             n.increment();
             AssertThat(n.get(encoding::hex).bytes, Equals("00000000000000000000000000000000" "0100000000000001"));
         });
+        it("can increment by a count", [&](){
+            nonce64 n = nonce64(encoded_bytes("00000000000000000000000000000000", encoding::hex), encoded_bytes("00000000000000fe", encoding::hex));
+            nonce64 stepped = n;
+            for(int i = 0; i < 300; ++i) stepped.increment();
+            n.increment(300);
+            AssertThat(n.get(encoding::hex).bytes, Equals(stepped.get(encoding::hex).bytes));
+            AssertThat(n.get(encoding::hex).bytes, Equals("00000000000000000000000000000000" "0000000000000356"));
+
+            n = nonce64(encoded_bytes("00000000000000000000000000000000", encoding::hex), encoded_bytes("0000000000000000", encoding::hex));
+            n.increment(0x8000000000000000ULL);
+            AssertThrows(std::overflow_error, n.get());
+        });
+        it("can increment short sequential parts", [&](){
+            nonce16 n = nonce16(encoded_bytes(std::string(22, 0), encoding::binary), encoded_bytes("fefa", encoding::hex));
+            n.increment();
+            AssertThat(n.get_sequential(encoding::hex).bytes, Equals("fefc"));
+            n.increment(2);
+            AssertThat(n.get_sequential(encoding::hex).bytes, Equals("ff00"));
+            n.increment(0x7f);
+            AssertThat(n.get_sequential(encoding::hex).bytes, Equals("fffe"));
+            n.increment();
+            AssertThrows(std::overflow_error, n.get());
+        });
+        it("exposes its bytes without copying", [&](){
+            nonce64 n(encoded_bytes("000102030405060708090a0b0c0d0e0f", encoding::hex), encoded_bytes("0000000000000002", encoding::hex));
+            AssertThat(std::string(reinterpret_cast<const char *>(n.data()), crypto_box_NONCEBYTES), Equals(n.get().to_binary()));
+            n.increment(0x7fffffffffffffffULL);
+            AssertThrows(std::overflow_error, n.data());
+        });
         it("can detect overflow", [&](){
             nonce64 n = nonce64(encoded_bytes("00000000000000000000000000000000", encoding::hex), encoded_bytes("fffffffffffffffe", encoding::hex));
             AssertThat(n.get(encoding::hex).bytes, Equals("00000000000000000000000000000000" "fffffffffffffffe"));
@@ -30,6 +30,12 @@
 
 #include <assert.h>
 #include <limits.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define Z85_X86_SIMD 1
+#include <immintrin.h>
+#endif
 
 #include <sodiumpp/z85.h>
 
@@ -71,10 +77,15 @@ static byte base256[] =
    0x00, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10,
    0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18,
    0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20,
-   0x21, 0x22, 0x23, 0x4F, 0x00, 0x50, 0x00, 0x00
+   0x21, 0x22, 0x23, 0x4F, 0x00, 0x50, 0x00, 0x00,
+   // (c - 32) & 127 for characters below 32 or above 127
+   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
 };
 
-char* Z85_encode_unsafe(const char* source, const char* sourceEnd, char* dest)
+char* Z85_encode_unsafe_scalar(const char* source, const char* sourceEnd, char* dest)
 {
    byte* src = (byte*)source;
    byte* end = (byte*)sourceEnd;
@@ -85,7 +96,7 @@ char* Z85_encode_unsafe(const char* source, const char* sourceEnd, char* dest)
    for (; src != end; src += 4, dst += 5)
    {
       // unpack big-endian frame
-      value = (src[0] << 24) | (src[1] << 16) | (src[2] << 8) | src[3];
+      value = ((uint32_t)src[0] << 24) | (src[1] << 16) | (src[2] << 8) | src[3];
 
       value2 = DIV85(value); dst[4] = base85[value - value2 * 85]; value = value2;
       value2 = DIV85(value); dst[3] = base85[value - value2 * 85]; value = value2;
@@ -97,7 +108,7 @@ char* Z85_encode_unsafe(const char* source, const char* sourceEnd, char* dest)
    return (char*)dst;
 }
 
-char* Z85_decode_unsafe(const char* source, const char* sourceEnd, char* dest)
+char* Z85_decode_unsafe_scalar(const char* source, const char* sourceEnd, char* dest)
 {
    byte* src = (byte*)source;
    byte* end = (byte*)sourceEnd;
@@ -122,6 +133,332 @@ char* Z85_decode_unsafe(const char* source, const char* sourceEnd, char* dest)
    return (char*)dst;
 }
 
+#ifdef Z85_X86_SIMD
+
+/*
+ * SIMD kernels. Every 32-bit lane holds one 4-byte frame; within each 128-bit lane 4 frames
+ * are converted with the same DIV85 arithmetic as the scalar code, and the 85 digits are
+ * translated to characters (and back) with 16-entry byte shuffles.
+ */
+
+#define Z85_SSE41 __attribute__((target("sse4.1")))
+#define Z85_AVX2  __attribute__((target("avx2")))
+
+// base85 split in 16-byte blocks for byte shuffles
+static const byte base85_blocks[6][16] =
+{
+   { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' },
+   { 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v' },
+   { 'w', 'x', 'y', 'z', 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L' },
+   { 'M', 'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z', '.', '-' },
+   { ':', '+', '=', '^', '!', '/', '*', '?', '&', '<', '>', '(', ')', '[', ']', '{' },
+   { '}', '@', '%', '$', '#', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }
+};
+
+// base256 for characters 32 to 127, with 0xFF for characters that are not in the alphabet
+static const byte base256_blocks[6][16] =
+{
+   { 0xFF, 0x44, 0xFF, 0x54, 0x53, 0x52, 0x48, 0xFF, 0x4B, 0x4C, 0x46, 0x41, 0xFF, 0x3F, 0x3E, 0x45 },
+   { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x40, 0xFF, 0x49, 0x42, 0x4A, 0x47 },
+   { 0x51, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32 },
+   { 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x4D, 0xFF, 0x4E, 0x43, 0xFF },
+   { 0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18 },
+   { 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x4F, 0xFF, 0x50, 0xFF, 0xFF }
+};
+
+#define Z85_Z -1 // shuffle index that produces a zero byte
+
+// big-endian frames <-> 32-bit lanes
+#define Z85_BSWAP 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+// the first 16 output symbols of 4 frames from the 4 leading digits (head) and the last digit (tail)
+#define Z85_ENCODE_HEAD_LO 0, 1, 2, 3, Z85_Z, 4, 5, 6, 7, Z85_Z, 8, 9, 10, 11, Z85_Z, 12
+#define Z85_ENCODE_TAIL_LO Z85_Z, Z85_Z, Z85_Z, Z85_Z, 0, Z85_Z, Z85_Z, Z85_Z, Z85_Z, 4, Z85_Z, Z85_Z, Z85_Z, Z85_Z, 8, Z85_Z
+// the last 4 output symbols
+#define Z85_ENCODE_HEAD_HI 13, 14, 15, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z
+#define Z85_ENCODE_TAIL_HI Z85_Z, Z85_Z, Z85_Z, 12, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z
+// the 4 leading digits (head) and the last digit (tail) of 4 frames, from the first 16 symbols (lo) and the 16 symbols at offset 4 (hi)
+#define Z85_DECODE_HEAD_LO 0, 1, 2, 3, 5, 6, 7, 8, 10, 11, 12, 13, Z85_Z, Z85_Z, Z85_Z, Z85_Z
+#define Z85_DECODE_HEAD_HI Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, 11, 12, 13, 14
+#define Z85_DECODE_TAIL_LO 4, Z85_Z, Z85_Z, Z85_Z, 9, Z85_Z, Z85_Z, Z85_Z, 14, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z
+#define Z85_DECODE_TAIL_HI Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, Z85_Z, 15, Z85_Z, Z85_Z, Z85_Z
+// weights for d0 * 85 + d1 and d2 * 85 + d3 (maddubs), then (d0 * 85 + d1) * 85 * 85 + d2 * 85 + d3 (madd)
+#define Z85_WEIGHTS_85_1   0x0155
+#define Z85_WEIGHTS_7225_1 0x00011C39
+
+/*
+ * Table lookup of every byte of index (0 to 95) in 6 blocks of 16 entries.
+ * A byte shuffle yields zero where the index has its high bit set, so after subtracting 16 * k from the index
+ * block k only contributes to bytes with index >= 16 * k. Shuffling the xor of consecutive blocks
+ * and xoring the results therefore leaves exactly the entry of the block the index falls in.
+ */
+Z85_SSE41 static inline __m128i z85_lookup_sse41(const byte blocks[6][16], __m128i index)
+{
+   __m128i prev   = _mm_setzero_si128();
+   __m128i result = _mm_setzero_si128();
+   int i;
+   for (i = 0; i < 6; ++i)
+   {
+      __m128i block = _mm_loadu_si128((const __m128i*)blocks[i]);
+      result = _mm_xor_si128(result, _mm_shuffle_epi8(_mm_xor_si128(block, prev), index));
+      index  = _mm_sub_epi8(index, _mm_set1_epi8(16));
+      prev   = block;
+   }
+   return result;
+}
+
+Z85_SSE41 static inline __m128i z85_mul85_sse41(__m128i value)
+{
+   return _mm_add_epi32(_mm_add_epi32(_mm_slli_epi32(value, 6), _mm_slli_epi32(value, 4)),
+                        _mm_add_epi32(_mm_slli_epi32(value, 2), value));
+}
+
+Z85_SSE41 static inline __m128i z85_div85_sse41(__m128i value)
+{
+   const __m128i magic = _mm_set1_epi32((int)DIV85_MAGIC);
+   __m128i even = _mm_srli_epi64(_mm_mul_epu32(value, magic), 38);
+   __m128i odd  = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(value, 32), magic), 38);
+   return _mm_blend_epi16(even, _mm_slli_epi64(odd, 32), 0xCC);
+}
+
+Z85_SSE41 static void z85_encode4_sse41(const byte* src, byte* dst)
+{
+   __m128i value = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)src), _mm_setr_epi8(Z85_BSWAP));
+   __m128i q, head, tail;
+   int last;
+   int i;
+
+   q    = z85_div85_sse41(value);
+   tail = _mm_sub_epi32(value, z85_mul85_sse41(q));
+   head = _mm_setzero_si128();
+   for (i = 0; i < 3; ++i)
+   {
+      value = q;
+      q     = z85_div85_sse41(value);
+      head  = _mm_or_si128(_mm_slli_epi32(head, 8), _mm_sub_epi32(value, z85_mul85_sse41(q)));
+   }
+   // digits 3, 2 and 1 from the high to the low byte and digit 0 below them: digit 0 to 3 in memory order
+   head = _mm_or_si128(_mm_slli_epi32(head, 8), q);
+   head = z85_lookup_sse41(base85_blocks, head);
+   tail = z85_lookup_sse41(base85_blocks, tail);
+
+   _mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_shuffle_epi8(head, _mm_setr_epi8(Z85_ENCODE_HEAD_LO)),
+                                                _mm_shuffle_epi8(tail, _mm_setr_epi8(Z85_ENCODE_TAIL_LO))));
+   last = _mm_cvtsi128_si32(_mm_or_si128(_mm_shuffle_epi8(head, _mm_setr_epi8(Z85_ENCODE_HEAD_HI)),
+                                         _mm_shuffle_epi8(tail, _mm_setr_epi8(Z85_ENCODE_TAIL_HI))));
+   memcpy(dst + 16, &last, 4);
+}
+
+// decodes the symbols in index (symbol - 32) to digits, and sets invalid to 0xFF where a symbol is not in the alphabet
+Z85_SSE41 static inline __m128i z85_digits_sse41(__m128i index, __m128i* invalid)
+{
+   const __m128i none = _mm_set1_epi8((char)0xFF);
+   __m128i digits = z85_lookup_sse41(base256_blocks, index);
+   __m128i out_of_range = _mm_cmpeq_epi8(_mm_max_epu8(index, _mm_set1_epi8(96)), index);
+   *invalid = _mm_or_si128(*invalid, _mm_or_si128(_mm_cmpeq_epi8(digits, none), out_of_range));
+   return digits;
+}
+
+// returns 0 without writing if a symbol is not in the alphabet
+Z85_SSE41 static int z85_decode4_sse41(const byte* src, byte* dst)
+{
+   __m128i invalid = _mm_setzero_si128();
+   __m128i lo = z85_digits_sse41(_mm_sub_epi8(_mm_loadu_si128((const __m128i*)src), _mm_set1_epi8(32)), &invalid);
+   __m128i hi = z85_digits_sse41(_mm_sub_epi8(_mm_loadu_si128((const __m128i*)(src + 4)), _mm_set1_epi8(32)), &invalid);
+   __m128i head, tail, value;
+
+   if (_mm_movemask_epi8(invalid))
+   {
+      return 0;
+   }
+
+   head  = _mm_or_si128(_mm_shuffle_epi8(lo, _mm_setr_epi8(Z85_DECODE_HEAD_LO)), _mm_shuffle_epi8(hi, _mm_setr_epi8(Z85_DECODE_HEAD_HI)));
+   tail  = _mm_or_si128(_mm_shuffle_epi8(lo, _mm_setr_epi8(Z85_DECODE_TAIL_LO)), _mm_shuffle_epi8(hi, _mm_setr_epi8(Z85_DECODE_TAIL_HI)));
+   value = _mm_madd_epi16(_mm_maddubs_epi16(head, _mm_set1_epi16(Z85_WEIGHTS_85_1)), _mm_set1_epi32(Z85_WEIGHTS_7225_1));
+   value = _mm_add_epi32(z85_mul85_sse41(value), tail);
+
+   _mm_storeu_si128((__m128i*)dst, _mm_shuffle_epi8(value, _mm_setr_epi8(Z85_BSWAP)));
+   return 1;
+}
+
+#define Z85_SETR_LANES(...) _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+
+Z85_AVX2 static inline __m256i z85_lookup_avx2(const byte blocks[6][16], __m256i index)
+{
+   __m256i prev   = _mm256_setzero_si256();
+   __m256i result = _mm256_setzero_si256();
+   int i;
+   for (i = 0; i < 6; ++i)
+   {
+      __m256i block = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)blocks[i]));
+      result = _mm256_xor_si256(result, _mm256_shuffle_epi8(_mm256_xor_si256(block, prev), index));
+      index  = _mm256_sub_epi8(index, _mm256_set1_epi8(16));
+      prev   = block;
+   }
+   return result;
+}
+
+Z85_AVX2 static inline __m256i z85_mul85_avx2(__m256i value)
+{
+   return _mm256_add_epi32(_mm256_add_epi32(_mm256_slli_epi32(value, 6), _mm256_slli_epi32(value, 4)),
+                           _mm256_add_epi32(_mm256_slli_epi32(value, 2), value));
+}
+
+Z85_AVX2 static inline __m256i z85_div85_avx2(__m256i value)
+{
+   const __m256i magic = _mm256_set1_epi32((int)DIV85_MAGIC);
+   __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(value, magic), 38);
+   __m256i odd  = _mm256_srli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(value, 32), magic), 38);
+   return _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+}
+
+Z85_AVX2 static void z85_encode8_avx2(const byte* src, byte* dst)
+{
+   __m256i value = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)src), Z85_SETR_LANES(Z85_BSWAP));
+   __m256i q, head, tail, out;
+   int last;
+   int i;
+
+   q    = z85_div85_avx2(value);
+   tail = _mm256_sub_epi32(value, z85_mul85_avx2(q));
+   head = _mm256_setzero_si256();
+   for (i = 0; i < 3; ++i)
+   {
+      value = q;
+      q     = z85_div85_avx2(value);
+      head  = _mm256_or_si256(_mm256_slli_epi32(head, 8), _mm256_sub_epi32(value, z85_mul85_avx2(q)));
+   }
+   head = _mm256_or_si256(_mm256_slli_epi32(head, 8), q);
+   head = z85_lookup_avx2(base85_blocks, head);
+   tail = z85_lookup_avx2(base85_blocks, tail);
+
+   // every 128-bit lane holds the 20 symbols of 4 frames
+   out = _mm256_or_si256(_mm256_shuffle_epi8(head, Z85_SETR_LANES(Z85_ENCODE_HEAD_LO)),
+                         _mm256_shuffle_epi8(tail, Z85_SETR_LANES(Z85_ENCODE_TAIL_LO)));
+   _mm_storeu_si128((__m128i*)dst, _mm256_castsi256_si128(out));
+   _mm_storeu_si128((__m128i*)(dst + 20), _mm256_extracti128_si256(out, 1));
+   out = _mm256_or_si256(_mm256_shuffle_epi8(head, Z85_SETR_LANES(Z85_ENCODE_HEAD_HI)),
+                         _mm256_shuffle_epi8(tail, Z85_SETR_LANES(Z85_ENCODE_TAIL_HI)));
+   last = _mm256_extract_epi32(out, 0);
+   memcpy(dst + 16, &last, 4);
+   last = _mm256_extract_epi32(out, 4);
+   memcpy(dst + 36, &last, 4);
+}
+
+Z85_AVX2 static inline __m256i z85_digits_avx2(__m256i index, __m256i* invalid)
+{
+   const __m256i none = _mm256_set1_epi8((char)0xFF);
+   __m256i digits = z85_lookup_avx2(base256_blocks, index);
+   __m256i out_of_range = _mm256_cmpeq_epi8(_mm256_max_epu8(index, _mm256_set1_epi8(96)), index);
+   *invalid = _mm256_or_si256(*invalid, _mm256_or_si256(_mm256_cmpeq_epi8(digits, none), out_of_range));
+   return digits;
+}
+
+// returns 0 without writing if a symbol is not in the alphabet
+Z85_AVX2 static int z85_decode8_avx2(const byte* src, byte* dst)
+{
+   const __m256i offset = _mm256_set1_epi8(32);
+   __m256i invalid = _mm256_setzero_si256();
+   // every 128-bit lane gets the 20 symbols of 4 frames
+   __m256i lo = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)src)),
+                                        _mm_loadu_si128((const __m128i*)(src + 20)), 1);
+   __m256i hi = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(src + 4))),
+                                        _mm_loadu_si128((const __m128i*)(src + 24)), 1);
+   __m256i head, tail, value;
+
+   lo = z85_digits_avx2(_mm256_sub_epi8(lo, offset), &invalid);
+   hi = z85_digits_avx2(_mm256_sub_epi8(hi, offset), &invalid);
+   if (_mm256_movemask_epi8(invalid))
+   {
+      return 0;
+   }
+
+   head  = _mm256_or_si256(_mm256_shuffle_epi8(lo, Z85_SETR_LANES(Z85_DECODE_HEAD_LO)), _mm256_shuffle_epi8(hi, Z85_SETR_LANES(Z85_DECODE_HEAD_HI)));
+   tail  = _mm256_or_si256(_mm256_shuffle_epi8(lo, Z85_SETR_LANES(Z85_DECODE_TAIL_LO)), _mm256_shuffle_epi8(hi, Z85_SETR_LANES(Z85_DECODE_TAIL_HI)));
+   value = _mm256_madd_epi16(_mm256_maddubs_epi16(head, _mm256_set1_epi16(Z85_WEIGHTS_85_1)), _mm256_set1_epi32(Z85_WEIGHTS_7225_1));
+   value = _mm256_add_epi32(z85_mul85_avx2(value), tail);
+
+   _mm256_storeu_si256((__m256i*)dst, _mm256_shuffle_epi8(value, Z85_SETR_LANES(Z85_BSWAP)));
+   return 1;
+}
+
+enum { Z85_SCALAR, Z85_USE_SSE41, Z85_USE_AVX2 };
+
+static int z85_simd_level(void)
+{
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2")) return Z85_USE_AVX2;
+   if (__builtin_cpu_supports("sse4.1")) return Z85_USE_SSE41;
+   return Z85_SCALAR;
+}
+
+#endif // Z85_X86_SIMD
+
+char* Z85_encode_unsafe(const char* source, const char* sourceEnd, char* dest)
+{
+#ifdef Z85_X86_SIMD
+   byte* src = (byte*)source;
+   byte* dst = (byte*)dest;
+   int   level = z85_simd_level();
+
+   if (level >= Z85_USE_AVX2)
+   {
+      // 16 frames per iteration
+      for (; sourceEnd - (char*)src >= 64; src += 64, dst += 80)
+      {
+         z85_encode8_avx2(src, dst);
+         z85_encode8_avx2(src + 32, dst + 40);
+      }
+   }
+   if (level >= Z85_USE_SSE41)
+   {
+      // 8 frames per iteration
+      for (; sourceEnd - (char*)src >= 32; src += 32, dst += 40)
+      {
+         z85_encode4_sse41(src, dst);
+         z85_encode4_sse41(src + 16, dst + 20);
+      }
+   }
+   source = (char*)src;
+   dest = (char*)dst;
+#endif
+   return Z85_encode_unsafe_scalar(source, sourceEnd, dest);
+}
+
+char* Z85_decode_unsafe(const char* source, const char* sourceEnd, char* dest)
+{
+#ifdef Z85_X86_SIMD
+   byte* src = (byte*)source;
+   byte* dst = (byte*)dest;
+   int   level = z85_simd_level();
+
+   if (level >= Z85_USE_AVX2)
+   {
+      // 16 frames per iteration
+      for (; sourceEnd - (char*)src >= 80; src += 80, dst += 64)
+      {
+         if (!z85_decode8_avx2(src, dst) || !z85_decode8_avx2(src + 40, dst + 32))
+         {
+            Z85_decode_unsafe_scalar((char*)src, (char*)src + 80, (char*)dst);
+         }
+      }
+   }
+   if (level >= Z85_USE_SSE41)
+   {
+      // 8 frames per iteration
+      for (; sourceEnd - (char*)src >= 40; src += 40, dst += 32)
+      {
+         if (!z85_decode4_sse41(src, dst) || !z85_decode4_sse41(src + 20, dst + 16))
+         {
+            Z85_decode_unsafe_scalar((char*)src, (char*)src + 40, (char*)dst);
+         }
+      }
+   }
+   source = (char*)src;
+   dest = (char*)dst;
+#endif
+   return Z85_decode_unsafe_scalar(source, sourceEnd, dest);
+}
+
 size_t Z85_encode_bound(size_t size)
 {
    return size * 5 / 4;
@@ -31,6 +31,8 @@
 #include <sodiumpp/z85.hpp>
 
 #include <cassert>
+#include <cstring>
+#include <stdexcept>
 
 #include <sodiumpp/z85.h>
 
@@ -137,5 +139,178 @@ std::string decode(const std::string& source)
    return decode(source.c_str(), source.size());
 }
 
+encoder::encoder()
+   : padded(false), started(false), remaining(0), pendingSize(0)
+{
+}
+
+encoder::encoder(unsigned long long totalSize)
+   : padded(true), started(false), remaining(totalSize), pendingSize(0)
+{
+}
+
+size_t encoder::start(char* dest)
+{
+   started = true;
+   // zero length streams are not padded
+   if (!padded || remaining == 0)
+   {
+      return 0;
+   }
+   const unsigned tailBytes = (unsigned)(remaining % 4);
+   dest[0] = (char)(tailBytes == 0 ? '4' : '0' + tailBytes);
+   return 1;
+}
+
+size_t encoder::update(const char* source, size_t inputSize, char* dest)
+{
+   char* dst = dest;
+
+   if (padded && inputSize > remaining)
+   {
+      throw std::invalid_argument("more bytes than announced");
+   }
+   if (!started)
+   {
+      dst += start(dst);
+   }
+   remaining -= padded ? inputSize : 0;
+
+   // complete a frame carried over from the previous call
+   if (pendingSize > 0)
+   {
+      const size_t n = inputSize < 4 - pendingSize ? inputSize : 4 - pendingSize;
+      memcpy(pending + pendingSize, source, n);
+      pendingSize += n;
+      source += n;
+      inputSize -= n;
+      if (pendingSize < 4)
+      {
+         return dst - dest;
+      }
+      dst = Z85_encode_unsafe(pending, pending + 4, dst);
+      pendingSize = 0;
+   }
+
+   const size_t body = inputSize - inputSize % 4;
+   dst = Z85_encode_unsafe(source, source + body, dst);
+   pendingSize = inputSize - body;
+   memcpy(pending, source + body, pendingSize);
+
+   return dst - dest;
+}
+
+size_t encoder::finish(char* dest)
+{
+   char* dst = dest;
+
+   if (padded && remaining != 0)
+   {
+      throw std::invalid_argument("fewer bytes than announced");
+   }
+   if (!padded && pendingSize != 0)
+   {
+      throw std::invalid_argument("input size must be divisible by 4 without padding");
+   }
+   if (!started)
+   {
+      dst += start(dst);
+   }
+   if (pendingSize > 0)
+   {
+      memset(pending + pendingSize, 0, 4 - pendingSize);
+      dst = Z85_encode_unsafe(pending, pending + 4, dst);
+      pendingSize = 0;
+   }
+
+   return dst - dest;
+}
+
+decoder::decoder(bool padded)
+   : padded(padded), tailBytes(0), holding(false), pendingSize(0)
+{
+}
+
+size_t decoder::update(const char* source, size_t inputSize, char* dest)
+{
+   char* dst = dest;
+
+   if (padded && tailBytes == 0 && inputSize > 0)
+   {
+      tailBytes = (unsigned char)source[0] - '0';
+      if (tailBytes - 1 > 3)
+      {
+         throw std::invalid_argument("wrong padding");
+      }
+      ++source;
+      --inputSize;
+   }
+
+   if (pendingSize > 0)
+   {
+      const size_t n = inputSize < 5 - pendingSize ? inputSize : 5 - pendingSize;
+      memcpy(pending + pendingSize, source, n);
+      pendingSize += n;
+      source += n;
+      inputSize -= n;
+      if (pendingSize < 5)
+      {
+         return 0;
+      }
+      dst = decodeFrames(pending, 5, dst);
+      pendingSize = 0;
+   }
+
+   const size_t body = inputSize - inputSize % 5;
+   dst = decodeFrames(source, body, dst);
+   pendingSize = inputSize - body;
+   memcpy(pending, source + body, pendingSize);
+
+   return dst - dest;
+}
+
+char* decoder::decodeFrames(const char* source, size_t size, char* dest)
+{
+   if (size == 0)
+   {
+      return dest;
+   }
+   if (!padded)
+   {
+      return Z85_decode_unsafe(source, source + size, dest);
+   }
+
+   // in padded mode the last frame is decoded into 'held', as it may be the padded one,
+   // and the frame held before it is released, so no more than 4 bytes per frame are written
+   if (holding)
+   {
+      memcpy(dest, held, 4);
+      dest += 4;
+   }
+   dest = Z85_decode_unsafe(source, source + size - 5, dest);
+   Z85_decode_unsafe(source + size - 5, source + size, held);
+   holding = true;
+   return dest;
+}
+
+size_t decoder::finish(char* dest)
+{
+   if (pendingSize != 0)
+   {
+      throw std::invalid_argument("truncated input");
+   }
+   if (!padded || tailBytes == 0)
+   {
+      return 0;
+   }
+   if (!holding)
+   {
+      throw std::invalid_argument("truncated input");
+   }
+   memcpy(dest, held, tailBytes);
+   holding = false;
+   return tailBytes;
+}
+
 } // namespace z85
 